@@ -0,0 +1,80 @@
+--
+-- Workloads driven by krabby_bench. Keep them stable, results are only comparable between runs of the same script.
+--
+
+-- static: a mounted file
+Mount( "/public", "public" )
+
+-- template: renders a page with a list of items
+Get( "/bench/template", {},
+    function(who, req, matches, params)
+        local items = json.parse("[]")
+        for i = 1, 20 do
+            local item = json.new()
+            item:int("id", i)
+            item:str("name", "item <"..i..">")
+            items:push_back(item)
+        end
+
+        local data = json.new()
+        data:str("title", "Krabby benchmark")
+        data:obj("items", items)
+
+        respond(who, 200, "text/html", template:render_file("templates/bench.j2", data))
+    end )
+
+-- regex route: the matching route is registered after a few that have to be tried first
+for _, name in ipairs({ "orders", "carts", "invoices", "products", "reviews" }) do
+    Get( "/bench/"..name.."/(\\d+)/items/(\\w+)", {},
+        function(who, req, matches, params)
+            respond_text(who, 200, name)
+        end )
+end
+
+Get( "/bench/users/(\\d+)/posts/([\\w-]+)", {"page"},
+    function(who, req, matches, params)
+        respond_text(who, 200, "user "..matches[2].." post "..matches[3].." page "..params["page"])
+    end )
+
+-- storage: one write and one read per request
+Post( "/bench/storage", {"key", "value"},
+    function(who, req, matches, params)
+        local record = json.new()
+        record:str("value", params["value"])
+        storage:save(params["key"], record)
+
+        respond(who, 200, "application/json", storage:load(params["key"], json.new()):dump())
+    end )
+
+-- websocket: echoes every message back
+Get( "/bench/ws", {},
+    function(who, req, matches, params)
+        who:upgrade(
+            function(msg)
+                respond_msg(who, msg.body)
+                return true
+            end,
+            function()
+            end )
+    end )
+
+-- compute: interpreter bound work, runs through the krabby.* calls so LuaJIT builds go through the ffi
+Get( "/bench/compute", {},
+    function(who, req, matches, params)
+        local sum = 0
+        for i = 1, 2000 do
+            sum = (sum + i * i) % 1000003
+        end
+
+        local doc = json.new()
+        for i = 1, 50 do
+            krabby.json_set_int(doc, "n"..i, i + sum)
+        end
+
+        local total = 0
+        for i = 1, 50 do
+            total = total + krabby.json_int(doc, "n"..i, 0)
+        end
+
+        krabby.respond(who, 200, "text/html", krabby.escape_html("<b>"..total.."</b>"))
+    end )
@@ -0,0 +1,366 @@
+#include "load.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace schwifty::krabby::bench {
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+// any fixed key will do, the server only hashes it
+constexpr std::string_view ws_key     = "dGhlIHNhbXBsZSBub25jZQ==";
+constexpr std::string_view ws_payload = "krabby benchmark echo";
+
+struct connection {
+	enum class state { http, upgrading, websocket };
+
+	int fd = -1;
+	state st;
+	std::string out;  // bytes not yet written
+	std::string in;   // bytes read but not yet parsed
+	clock::time_point sent;
+};
+
+int open_socket(uint16_t port) {
+	auto fd = ::socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	sockaddr_in addr{};
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	// connecting to loopback does not block for long, so it is done before switching to non blocking
+	if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+		::close(fd);
+		return -1;
+	}
+
+	int one = 1;
+	::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	return fd;
+}
+
+bool iequals_prefix(std::string_view line, std::string_view prefix) {
+	if (line.size() < prefix.size())
+		return false;
+	for (size_t i = 0; i < prefix.size(); ++i) {
+		if (std::tolower(static_cast<unsigned char>(line[i])) != prefix[i])
+			return false;
+	}
+	return true;
+}
+
+struct http_response {
+	size_t size = 0;  // 0 until the whole response has been read
+	int status  = 0;
+	bool close  = false;
+};
+
+// understands just enough of http/1.1 to read krabby's responses off a keep-alive connection
+http_response parse_response(std::string_view in) {
+	http_response r;
+	auto end = in.find("\r\n\r\n");
+	if (end == std::string_view::npos || in.size() < 12)
+		return r;
+
+	r.status = std::atoi(std::string{in.substr(9, 3)}.c_str());
+
+	size_t length = 0;
+	auto headers  = in.substr(0, end + 2);
+	for (auto pos = headers.find("\r\n"); pos != std::string_view::npos && pos + 2 < headers.size();) {
+		auto next = headers.find("\r\n", pos + 2);
+		auto line = headers.substr(pos + 2, next - pos - 2);
+		if (iequals_prefix(line, "content-length:"))
+			length = std::strtoull(std::string{line.substr(15)}.c_str(), nullptr, 10);
+		else if (iequals_prefix(line, "connection:") && line.find("close") != std::string_view::npos)
+			r.close = true;
+		pos = next;
+	}
+
+	if (in.size() >= end + 4 + length)
+		r.size = end + 4 + length;
+	return r;
+}
+
+std::string ws_frame(std::string_view payload) {
+	const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+
+	std::string frame;
+	frame.push_back(static_cast<char>(0x81));  // fin, text
+	if (payload.size() < 126) {
+		frame.push_back(static_cast<char>(0x80 | payload.size()));
+	} else {
+		frame.push_back(static_cast<char>(0x80 | 126));
+		frame.push_back(static_cast<char>(payload.size() >> 8));
+		frame.push_back(static_cast<char>(payload.size() & 0xff));
+	}
+	frame.append(reinterpret_cast<const char *>(mask), 4);
+	for (size_t i = 0; i < payload.size(); ++i)
+		frame.push_back(static_cast<char>(payload[i] ^ mask[i % 4]));
+	return frame;
+}
+
+struct ws_message {
+	size_t size    = 0;  // 0 until the whole frame has been read
+	uint8_t opcode = 0;
+};
+
+ws_message parse_frame(std::string_view in) {
+	ws_message m;
+	if (in.size() < 2)
+		return m;
+
+	auto b0 = static_cast<uint8_t>(in[0]);
+	auto b1 = static_cast<uint8_t>(in[1]);
+
+	size_t header = 2;
+	uint64_t len  = b1 & 0x7f;
+	if (len == 126) {
+		if (in.size() < 4)
+			return m;
+		len    = (uint64_t(uint8_t(in[2])) << 8) | uint8_t(in[3]);
+		header = 4;
+	} else if (len == 127) {
+		if (in.size() < 10)
+			return m;
+		len = 0;
+		for (size_t i = 0; i < 8; ++i)
+			len = (len << 8) | uint8_t(in[2 + i]);
+		header = 10;
+	}
+	if (b1 & 0x80)
+		header += 4;  // servers don't mask, but be lenient
+
+	if (in.size() >= header + len) {
+		m.size   = header + len;
+		m.opcode = b0 & 0x0f;
+	}
+	return m;
+}
+
+class generator {
+public:
+	generator(const scenario &s, uint16_t port, size_t connections) : s_{s}, port_{port} {
+		if (s_.websocket) {
+			request_ = fmt::format(
+			    "GET {} HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+			    "Sec-WebSocket-Key: {}\r\nSec-WebSocket-Version: 13\r\n\r\n",
+			    s_.path, ws_key);
+			frame_ = ws_frame(ws_payload);
+		} else {
+			request_ = fmt::format("{} {} HTTP/1.1\r\nHost: 127.0.0.1\r\n{}\r\n", s_.method, s_.path,
+			    s_.method == "GET" ? "" : "Content-Length: 0\r\n");
+		}
+
+		conns_.resize(connections);
+		for (auto &c : conns_)
+			reopen(c);
+	}
+
+	~generator() {
+		for (auto &c : conns_) {
+			if (c.fd >= 0)
+				::close(c.fd);
+		}
+	}
+
+	result run(double duration) {
+		auto start = clock::now();
+		auto stop  = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(duration));
+		std::vector<pollfd> fds(conns_.size());
+
+		while (clock::now() < stop) {
+			for (size_t i = 0; i < conns_.size(); ++i) {
+				if (conns_[i].fd < 0)
+					reopen(conns_[i]);  // the server refused us earlier, try again
+
+				fds[i].fd      = conns_[i].fd;
+				fds[i].events  = POLLIN | (conns_[i].out.empty() ? 0 : POLLOUT);
+				fds[i].revents = 0;
+			}
+
+			if (::poll(fds.data(), fds.size(), 100) < 0 && errno != EINTR)
+				break;
+
+			for (size_t i = 0; i < conns_.size(); ++i) {
+				auto &c = conns_[i];
+				if (fds[i].revents & (POLLERR | POLLNVAL))
+					fail(c);
+				else if ((fds[i].revents & POLLOUT) && !flush(c))
+					fail(c);
+				else if ((fds[i].revents & (POLLIN | POLLHUP)) && !receive(c))
+					fail(c);
+			}
+		}
+
+		auto elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+		result r;
+		r.name     = s_.name;
+		r.requests = latencies_.size();
+		r.errors   = errors_;
+		r.seconds  = elapsed;
+		r.rps      = elapsed > 0 ? static_cast<double>(latencies_.size()) / elapsed : 0;
+
+		if (!latencies_.empty()) {
+			auto at = [this](double q) {
+				auto n = std::min(static_cast<size_t>(q * static_cast<double>(latencies_.size())),
+				    latencies_.size() - 1);
+				std::nth_element(latencies_.begin(), latencies_.begin() + n, latencies_.end());
+				return latencies_[n];
+			};
+			r.p50  = at(0.5);
+			r.p99  = at(0.99);
+			r.p999 = at(0.999);
+			r.max  = *std::max_element(latencies_.begin(), latencies_.end());
+		}
+		return r;
+	}
+
+private:
+	void reopen(connection &c) {
+		if (c.fd >= 0)
+			::close(c.fd);
+
+		c.fd = open_socket(port_);
+		c.in.clear();
+		c.st = s_.websocket ? connection::state::upgrading : connection::state::http;
+		send(c, request_);
+	}
+
+	void fail(connection &c) {
+		++errors_;
+		reopen(c);
+	}
+
+	void send(connection &c, const std::string &data) {
+		c.out  = data;
+		c.sent = clock::now();
+		flush(c);
+	}
+
+	bool flush(connection &c) {
+		while (!c.out.empty()) {
+			auto n = ::send(c.fd, c.out.data(), c.out.size(), 0);  // SIGPIPE is ignored by the bench
+			if (n < 0)
+				return errno == EAGAIN || errno == EWOULDBLOCK;
+			c.out.erase(0, static_cast<size_t>(n));
+		}
+		return true;
+	}
+
+	void done(connection &c) {
+		latencies_.push_back(
+		    std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - c.sent).count());
+	}
+
+	bool receive(connection &c) {
+		char buf[16384];
+		for (;;) {
+			auto n = ::recv(c.fd, buf, sizeof(buf), 0);
+			if (n == 0)
+				return false;
+			if (n < 0) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					break;
+				return false;
+			}
+			c.in.append(buf, static_cast<size_t>(n));
+		}
+
+		switch (c.st) {
+		case connection::state::http: {
+			auto r = parse_response(c.in);
+			if (r.size == 0)
+				return true;
+
+			done(c);
+			if (r.status >= 400)
+				++errors_;
+			if (r.close) {
+				reopen(c);
+				return true;
+			}
+			c.in.erase(0, r.size);
+			send(c, request_);
+			return true;
+		}
+		case connection::state::upgrading: {
+			auto end = c.in.find("\r\n\r\n");
+			if (end == std::string::npos)
+				return true;
+			if (end < 12 || c.in.compare(9, 3, "101") != 0)  // "HTTP/1.1 101"
+				return false;
+
+			c.in.erase(0, end + 4);
+			c.st = connection::state::websocket;
+			send(c, frame_);
+			return true;
+		}
+		case connection::state::websocket: {
+			for (auto m = parse_frame(c.in); m.size > 0; m = parse_frame(c.in)) {
+				c.in.erase(0, m.size);
+				if (m.opcode == 0x8)
+					return false;  // closed by the server
+				if (m.opcode == 0x1 || m.opcode == 0x2) {
+					done(c);
+					send(c, frame_);
+				}
+			}
+			return true;
+		}
+		}
+		return true;
+	}
+
+	const scenario &s_;
+	uint16_t port_;
+	std::string request_;  // http request or websocket upgrade
+	std::string frame_;    // websocket message sent after the upgrade
+	std::vector<connection> conns_;
+	std::vector<uint64_t> latencies_;
+	uint64_t errors_ = 0;
+};
+
+}  // namespace
+
+result run(const scenario &s, uint16_t port, size_t connections, double duration) {
+	generator g{s, port, connections};
+	return g.run(duration);
+}
+
+bool wait_for_port(uint16_t port, double timeout) {
+	auto until = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(timeout));
+	while (clock::now() < until) {
+		auto fd = open_socket(port);
+		if (fd >= 0) {
+			::close(fd);
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+	return false;
+}
+
+}  // namespace schwifty::krabby::bench
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace schwifty::krabby::bench {
+
+struct scenario {
+	std::string name;
+	std::string method;  // ignored for websockets
+	std::string path;    // request target or the path upgraded to a websocket
+	bool websocket = false;
+};
+
+struct result {
+	std::string name;
+	uint64_t requests = 0;  // completed requests or echoed messages
+	uint64_t errors   = 0;  // non 2xx/3xx responses and dropped connections
+	double seconds    = 0;
+	double rps        = 0;
+
+	// latencies in microseconds
+	uint64_t p50  = 0;
+	uint64_t p99  = 0;
+	uint64_t p999 = 0;
+	uint64_t max  = 0;
+};
+
+// closed loop load over loopback: every connection sends its next request as soon as
+// the previous response has been read, for `duration` seconds.
+result run(const scenario &s, uint16_t port, size_t connections, double duration);
+
+// true once something accepts connections on the port
+bool wait_for_port(uint16_t port, double timeout);
+
+}  // namespace schwifty::krabby::bench
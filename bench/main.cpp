@@ -0,0 +1,190 @@
+#include <unistd.h>
+#include <algorithm>
+#include <csignal>
+#include <cxxopts.hpp>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <thread>
+
+#include "load.hpp"
+#include "server.hpp"
+#include "services.hpp"
+
+using namespace schwifty::logger;
+using namespace schwifty::krabby;
+using json = nlohmann::json;
+
+namespace fs = std::filesystem;
+
+#ifndef KRABBY_BENCH_DATA
+#define KRABBY_BENCH_DATA "bench/data"
+#endif
+
+// the workloads served by bench/data/scripts/bench.lua
+const std::vector<bench::scenario> scenarios{
+    {"static", "GET", "/public/krabby.txt"},
+    {"template", "GET", "/bench/template"},
+    {"regex_route", "GET", "/bench/users/4242/posts/hello-krabby?page=2"},
+    {"storage", "POST", "/bench/storage?key=bench&value=krabby"},
+    {"websocket_echo", "GET", "/bench/ws", true},
+    {"compute", "GET", "/bench/compute"},
+};
+
+// runs krabby on its own thread and runloop, exactly like main() does
+class bench_server {
+public:
+	bench_server(std::string data_path, uint16_t port) {
+		std::promise<crab::Watcher *> ready;
+		auto started = ready.get_future();
+
+		thread_ = std::thread([data_path, port, &ready]() {
+			bool started = false;
+			try {
+				run(data_path, port, ready, started);
+			} catch (...) {
+				if (started)
+					throw;
+				ready.set_exception(std::current_exception());  // failed to start, main() cleans up and exits
+			}
+		});
+
+		try {
+			stop_ = started.get();
+		} catch (...) {
+			thread_.join();
+			throw;
+		}
+	}
+
+	~bench_server() {
+		stop_->call();
+		thread_.join();
+	}
+
+private:
+	static void run(
+	    const std::string &data_path, uint16_t port, std::promise<crab::Watcher *> &ready, bool &started) {
+		crab::RunLoop runloop;
+
+		services krabby{data_path, services::settings{}};
+		server app{port, data_path};
+
+		crab::Watcher stop{[&runloop]() { runloop.cancel(); }};
+		started = true;
+		ready.set_value(&stop);  // the promise is gone once the constructor returns
+
+		runloop.run();
+	}
+
+	std::thread thread_;
+	crab::Watcher *stop_;
+};
+
+// removes a directory on every way out of the scope
+class temp_dir {
+public:
+	explicit temp_dir(fs::path path) : path_{std::move(path)} {}
+
+	~temp_dir() {
+		std::error_code ec;
+		fs::remove_all(path_, ec);
+	}
+
+	temp_dir(const temp_dir &) = delete;
+	temp_dir &operator=(const temp_dir &) = delete;
+
+	const fs::path &path() const { return path_; }
+
+private:
+	fs::path path_;
+};
+
+int main(int argc, char *argv[]) {
+	uint16_t port{18080};
+	size_t connections{32};
+	double duration{5};
+	double warmup{1};
+	std::string data_source{KRABBY_BENCH_DATA};
+	std::string out_path;
+	std::vector<std::string> selected;
+
+	try {
+		cxxopts::Options options("krabby_bench", "Load tests krabby with reference workloads");
+
+		// clang-format off
+        options.add_options()
+            ("p,port", "Loopback TCP port krabby listens on", cxxopts::value<uint16_t>(port))
+            ("c,connections", "Concurrent connections per scenario", cxxopts::value<size_t>(connections))
+            ("d,duration", "Seconds each scenario is measured", cxxopts::value<double>(duration))
+            ("w,warmup", "Seconds each scenario runs before measuring", cxxopts::value<double>(warmup))
+            ("s,scenario", "Only run these scenarios (static, template, regex_route, storage, websocket_echo, compute)", cxxopts::value<std::vector<std::string>>(selected))
+            ("data", "Benchmark data root, copied to a temporary directory before the run", cxxopts::value<std::string>(data_source))
+            ("o,out", "Write the JSON results to this file instead of stdout", cxxopts::value<std::string>(out_path))
+            ("h,help", "Help message")
+        ;
+		// clang-format on
+
+		auto result = options.parse(argc, argv);
+		if (result.count("help")) {
+			fmt::print(options.help({""}));
+			return 0;
+		}
+	} catch (const cxxopts::OptionException &e) {
+		fmt::print(stderr, "Error parsing options: {}\n", e.what());
+		return 1;
+	}
+
+	std::signal(SIGPIPE, SIG_IGN);
+
+	// storage writes go to the data root, so every run starts from a pristine copy
+	temp_dir data_path{fs::temp_directory_path() / fmt::format("krabby_bench_{}", ::getpid())};
+	fs::copy(data_source, data_path.path(), fs::copy_options::recursive | fs::copy_options::overwrite_existing);
+
+	json report;
+	report["connections"] = connections;
+	report["duration"]    = duration;
+	report["lua"]         = UseLuaJit ? "luajit" : "lua";
+	report["scenarios"]   = json::array();
+
+	{
+		bench_server krabby{append_trailing_slash(data_path.path().string()), port};
+		if (!bench::wait_for_port(port, 10)) {
+			fmt::print(stderr, "krabby did not start listening on port {}\n", port);
+			return 1;
+		}
+
+		fmt::print(stderr, "{:<16} {:>10} {:>8} {:>10} {:>10} {:>10} {:>10}\n", "scenario", "rps", "errors",
+		    "p50 us", "p99 us", "p999 us", "max us");
+
+		for (auto &s : scenarios) {
+			if (!selected.empty() && std::find(selected.begin(), selected.end(), s.name) == selected.end())
+				continue;
+
+			if (warmup > 0)
+				bench::run(s, port, connections, warmup);
+			auto r = bench::run(s, port, connections, duration);
+
+			fmt::print(stderr, "{:<16} {:>10.0f} {:>8} {:>10} {:>10} {:>10} {:>10}\n", r.name, r.rps, r.errors,
+			    r.p50, r.p99, r.p999, r.max);
+
+			report["scenarios"].push_back({
+			    {"name", r.name},
+			    {"requests", r.requests},
+			    {"errors", r.errors},
+			    {"seconds", r.seconds},
+			    {"rps", r.rps},
+			    {"latency_us", {{"p50", r.p50}, {"p99", r.p99}, {"p999", r.p999}, {"max", r.max}}},
+			});
+		}
+	}
+
+	if (out_path.empty()) {
+		fmt::print("{}\n", report.dump(2));
+	} else {
+		std::ofstream out{out_path};
+		out << report.dump(2) << '\n';
+	}
+
+	return 0;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace schwifty::krabby::bench {
+
+// keeps the optimizer from dropping work whose result is otherwise unused
+template<typename T>
+inline void keep(T &&value) {
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// minimal benchmark harness: every case is calibrated to run for a fixed time per sample,
+// the median over several samples is reported so a single noisy sample doesn't skew the result
+class harness {
+public:
+	using body_t = std::function<void(size_t iterations)>;
+
+	struct result {
+		std::string name;
+		size_t iterations;  // per sample
+		double median_ns;   // per iteration
+		double min_ns;
+		double spread;  // (max - min) / median over all samples
+	};
+
+	harness(size_t samples, double sample_seconds) : samples_{samples}, sample_seconds_{sample_seconds} {}
+
+	void add(std::string name, body_t body) { cases_.push_back({std::move(name), std::move(body)}); }
+
+	std::vector<result> run(const std::string &filter) {
+		std::vector<result> results;
+		fmt::print(stderr, "{:<40} {:>12} {:>12} {:>8} {:>10}\n", "benchmark", "median ns", "min ns", "spread",
+		    "iters");
+
+		for (auto &c : cases_) {
+			if (!filter.empty() && c.name.find(filter) == std::string::npos)
+				continue;
+
+			auto r = measure(c);
+			fmt::print(stderr, "{:<40} {:>12.1f} {:>12.1f} {:>7.1f}% {:>10}\n", r.name, r.median_ns, r.min_ns,
+			    r.spread * 100, r.iterations);
+			results.push_back(std::move(r));
+		}
+		return results;
+	}
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	struct bench_case {
+		std::string name;
+		body_t body;
+	};
+
+	static double time(const body_t &body, size_t iterations) {
+		auto start = clock::now();
+		body(iterations);
+		return std::chrono::duration<double>(clock::now() - start).count();
+	}
+
+	result measure(const bench_case &c) {
+		// grow the iteration count until a run is long enough to time reliably, doubles as warm up
+		size_t iterations = 1;
+		auto elapsed      = time(c.body, iterations);
+		while (elapsed < sample_seconds_ / 10 && iterations < (size_t{1} << 40)) {
+			iterations *= 2;
+			elapsed = time(c.body, iterations);
+		}
+		iterations = std::max<size_t>(1, static_cast<size_t>(iterations * sample_seconds_ / elapsed));
+
+		std::vector<double> ns;
+		for (size_t i = 0; i < samples_; ++i)
+			ns.push_back(time(c.body, iterations) * 1e9 / static_cast<double>(iterations));
+		std::sort(ns.begin(), ns.end());
+
+		auto median = ns[ns.size() / 2];
+		return {c.name, iterations, median, ns.front(), median > 0 ? (ns.back() - ns.front()) / median : 0};
+	}
+
+	size_t samples_;
+	double sample_seconds_;
+	std::vector<bench_case> cases_;
+};
+
+}  // namespace schwifty::krabby::bench
@@ -0,0 +1,233 @@
+#include <unistd.h>
+#include <cxxopts.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#include "database.hpp"
+#include "harness.hpp"
+#include "mountpoint.hpp"
+#include "router.hpp"
+#include "script.hpp"
+#include "util.hpp"
+
+using namespace schwifty::krabby;
+using json = nlohmann::json;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// inputs are fixed so numbers are comparable between runs
+std::string sample_html(size_t size) {
+	const std::string chunk = "<p class=\"krabby\">Krabby & friends: 'claws' #1; 100% crab</p>\n";
+	std::string out;
+	while (out.size() < size)
+		out += chunk;
+	out.resize(size);
+	return out;
+}
+
+std::string sample_bytes(size_t size) {
+	std::string out(size, '\0');
+	for (size_t i = 0; i < size; ++i)
+		out[i] = static_cast<char>((i * 131 + 7) & 0xff);
+	return out;
+}
+
+void add_router(bench::harness &h, size_t routes) {
+	auto r = std::make_shared<router>();
+	for (size_t i = 0; i < routes; ++i) {
+		r->get(fmt::format("/api/v1/resource{}/(\\d+)", i),
+		    [](http::Client *, http::Request &, route_match &, query_params &) {});
+	}
+
+	// the last route matches, so every other one is tried first
+	auto request           = std::make_shared<http::Request>();
+	request->header.method = "GET";
+	request->header.path   = fmt::format("/api/v1/resource{}/4242", routes - 1);
+
+	h.add(fmt::format("router/handle/{}_routes", routes), [r, request](size_t n) {
+		for (size_t i = 0; i < n; ++i)
+			bench::keep(r->handle(nullptr, *request));
+	});
+}
+
+void add_utils(bench::harness &h) {
+	for (size_t size : {64, 1024, 16384}) {
+		h.add(fmt::format("util/escape_html/{}", size), [html = sample_html(size)](size_t n) {
+			for (size_t i = 0; i < n; ++i)
+				bench::keep(escape_html(html));
+		});
+	}
+
+	for (size_t size : {20, 1024}) {
+		h.add(fmt::format("util/string_to_hex/{}", size), [bytes = sample_bytes(size)](size_t n) {
+			for (size_t i = 0; i < n; ++i)
+				bench::keep(string_to_hex(bytes));
+		});
+	}
+
+	for (size_t size : {64, 1024}) {
+		h.add(fmt::format("util/hmac_sha1/{}", size), [msg = sample_bytes(size)](size_t n) {
+			for (size_t i = 0; i < n; ++i)
+				bench::keep(hmac_sha1(msg, "krabby secret key"));
+		});
+
+		h.add(fmt::format("util/hmac_sha256/{}", size), [msg = sample_bytes(size)](size_t n) {
+			for (size_t i = 0; i < n; ++i)
+				bench::keep(hmac_sha256(msg, "krabby secret key"));
+		});
+
+		// same secret every time, only the message is hashed
+		h.add(fmt::format("util/hmac_sha256_precomputed/{}", size), [msg = sample_bytes(size)](size_t n) {
+			hmac<sha256> mac{"krabby secret key"};
+			for (size_t i = 0; i < n; ++i) {
+				mac.update(msg);
+				bench::keep(mac.final());
+			}
+		});
+	}
+
+	h.add("util/generate_key/16", [](size_t n) {
+		for (size_t i = 0; i < n; ++i)
+			bench::keep(generate_key(16));
+	});
+
+	h.add("mountpoint/mime_type_for", [](size_t n) {
+		const std::string_view exts[] = {"html", "js", "css", "png", "jpg", "gif", "txt", "woff2"};
+		for (size_t i = 0; i < n; ++i)
+			bench::keep(mountpoint::mime_type_for(exts[i % std::size(exts)]));
+	});
+}
+
+void add_json(bench::harness &h) {
+	auto lua = std::make_shared<sol::state>();
+	lua->open_libraries(sol::lib::base);
+	script_engine::register_json(*lua);
+
+	lua->script(R"(
+		function json_accessors(n)
+			local j = json.new()
+			for i = 1, n do
+				j:str("name", "krabby")
+				j:int("age", 42)
+				j:dbl("weight", 1.5)
+				local name = j:str("name")
+				local age = j:int("age")
+			end
+		end
+
+		function json_build(n)
+			for i = 1, n do
+				local items = json.parse("[]")
+				for k = 1, 10 do
+					local item = json.new()
+					item:int("id", k)
+					item:str("name", "item")
+					items:push_back(item)
+				end
+				local data = json.new()
+				data:obj("items", items)
+			end
+		end
+
+		local doc = '{"name":"krabby","age":42,"tags":["crab","lua","http"],"nested":{"a":1,"b":[1,2,3]}}'
+		function json_parse_dump(n)
+			for i = 1, n do
+				local s = json.parse(doc):dump()
+			end
+		end
+	)");
+
+	for (std::string name : {"json_accessors", "json_build", "json_parse_dump"}) {
+		h.add(fmt::format("lua/{}", name), [lua, name](size_t n) {
+			sol::protected_function fn = (*lua)[name];
+			auto result                = fn(n);
+			if (!result.valid())
+				throw std::runtime_error(sol::error{result}.what());
+		});
+	}
+}
+
+void add_storage(bench::harness &h, const fs::path &path) {
+	auto db = std::make_shared<database>(append_trailing_slash(path.string()));
+
+	for (size_t size : {64, 1024, 16384}) {
+		auto key   = fmt::format("bench_{}", size);
+		auto value = sample_html(size);
+
+		h.add(fmt::format("database/save/{}", size), [db, key, value](size_t n) {
+			for (size_t i = 0; i < n; ++i)
+				db->storage().save(key, value);
+		});
+
+		h.add(fmt::format("database/load/{}", size), [db, key](size_t n) {
+			for (size_t i = 0; i < n; ++i)
+				bench::keep(db->storage().load(key, std::string{}));
+		});
+	}
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+	size_t samples{9};
+	double sample_seconds{0.05};
+	std::string filter;
+	std::string out_path;
+
+	try {
+		cxxopts::Options options("krabby_microbench", "Benchmarks krabby components without networking");
+
+		// clang-format off
+        options.add_options()
+            ("f,filter", "Only run benchmarks whose name contains this", cxxopts::value<std::string>(filter))
+            ("samples", "Timed samples per benchmark, the median is reported", cxxopts::value<size_t>(samples))
+            ("sample-time", "Seconds per sample", cxxopts::value<double>(sample_seconds))
+            ("o,out", "Write the JSON results to this file instead of stdout", cxxopts::value<std::string>(out_path))
+            ("h,help", "Help message")
+        ;
+		// clang-format on
+
+		auto result = options.parse(argc, argv);
+		if (result.count("help")) {
+			fmt::print(options.help({""}));
+			return 0;
+		}
+	} catch (const cxxopts::OptionException &e) {
+		fmt::print(stderr, "Error parsing options: {}\n", e.what());
+		return 1;
+	}
+
+	auto data_path = fs::temp_directory_path() / fmt::format("krabby_microbench_{}", ::getpid());
+	fs::create_directories(data_path);
+
+	std::vector<bench::harness::result> results;
+	{
+		bench::harness h{std::max<size_t>(samples, 1), sample_seconds};
+		for (size_t routes : {10, 100, 1000})
+			add_router(h, routes);
+		add_utils(h);
+		add_json(h);
+		add_storage(h, data_path);
+
+		results = h.run(filter);
+	}
+	fs::remove_all(data_path);
+
+	auto report = json::array();
+	for (auto &r : results) {
+		report.push_back({{"name", r.name}, {"iterations", r.iterations}, {"median_ns", r.median_ns},
+		    {"min_ns", r.min_ns}, {"spread", r.spread}});
+	}
+
+	if (out_path.empty()) {
+		fmt::print("{}\n", report.dump(2));
+	} else {
+		std::ofstream out{out_path};
+		out << report.dump(2) << '\n';
+	}
+
+	return 0;
+}
@@ -1,5 +1,6 @@
 -- 
 -- JSON API request example
+-- start krabby with --client-cache to answer repeated requests without hitting the upstream every time
 --
 Get( "/apireq", {},
     function(who, req, matches, params)        
@@ -25,6 +25,17 @@ Get( "/util", {},
         -- compute a hmac sha1 with a shared secret
         local hmacsha1 = hmac_sha1(str, secret)
         data:str("hmacsha1", hmacsha1)
+
+        -- hash a message piece by piece
+        local hasher = sha256.new()
+        hasher:update("Krabby loves ")
+        hasher:update("you <3")
+        data:str("sha256hex", string_to_hex(hasher:final()))
+
+        -- keep a hmac around to sign many messages with the same secret
+        local signer = hmac.sha256(secret)
+        signer:update(str)
+        data:str("hmacsha256", string_to_hex(signer:final()))
         
         local html = "<b>Krabby</b>"
         local escaped = escape_html(html)
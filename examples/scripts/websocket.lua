@@ -12,6 +12,12 @@ Get ( "/ws", {},
 -- websocket api example
 Get( "/ws/api", {},
     function(who, req, matches, params)        
+        -- keep the connection alive with a ping every 30 seconds
+        local heartbeat = timer.every(30,
+            function()
+                respond_msg(who, "ping")
+            end )
+
         who:upgrade(
             function(msg)
                 print("web socket msg")
@@ -22,6 +28,7 @@ Get( "/ws/api", {},
                 -- will close connection here because implicit false is returned
             end,
             function()
+                heartbeat:cancel()
                 print("web socket closed")
             end ) -- upgrade to websocket connection
         respond_msg(who, "hello")
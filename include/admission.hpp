@@ -0,0 +1,97 @@
+#pragma once
+
+#include <crab/crab.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <unordered_set>
+
+#include "metrics.hpp"
+
+namespace schwifty::krabby {
+
+namespace http = crab::http;
+
+// decides whether a request is handled now, waits in a queue or is turned away with a 503 before any lua runs.
+// requests are handled one at a time on the run loop, so a request stays in flight only while its response is
+// postponed; postponing is what the in-flight limit bounds. a limit of 0 means unlimited.
+class admission {
+public:
+	struct settings {
+		size_t max_in_flight    = 0;  // requests admitted but not answered yet
+		size_t max_queued       = 0;  // requests waiting for an in-flight slot, more are shed
+		double queue_timeout    = 1;  // seconds a request may wait in the queue before it is shed
+		size_t max_websockets   = 0;  // open websocket connections, more upgrades are refused
+		size_t max_client_calls = 0;  // pending outgoing client requests above which new requests are shed
+		unsigned retry_after    = 1;  // seconds suggested to shed clients
+	};
+
+	using arrival_t       = std::chrono::steady_clock::time_point;
+	using dispatch_t      = std::function<void(http::Client *, http::Request &, arrival_t)>;
+	using pending_calls_t = std::function<size_t()>;
+
+	explicit admission(settings s, pending_calls_t &&pending_calls = {});
+
+	admission(const admission &) = delete;
+	admission &operator=(const admission &) = delete;
+
+	dispatch_t dispatch;  // handles a queued request once there is room, with the time it arrived
+
+	// true if the request should be dispatched right away, otherwise it was queued or already answered
+	bool admit(http::Client *who, http::Request &request);
+
+	// the response of who will be written later, d_handler runs if the client goes away before that
+	void postpone(http::Client *who, crab::Handler &&d_handler);
+
+	// a response was written to who
+	void answered(http::Client *who);
+
+	// a pending client call finished, queued requests held back by max_client_calls may go now
+	void call_finished();
+
+	// false if the upgrade has to be refused, d_handler is wrapped to keep count of open sockets
+	bool open_websocket(crab::Handler &d_handler);
+
+	// 503 with Retry-After
+	void reject(http::Client *who);
+
+	size_t in_flight() const { return postponed_.size(); }
+	size_t queued() const { return queue_.size(); }
+	size_t websockets() const { return websockets_; }
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	struct waiting {
+		http::Client *who;
+		http::Request request;
+		clock::time_point arrived;
+		clock::time_point deadline;
+	};
+
+	bool has_room() const;
+	bool calls_overloaded() const;
+	void shed(http::Client *who, std::atomic<uint64_t> &reason);
+	void schedule_drain();
+	void drain();
+	void expire();
+
+	settings settings_;
+	pending_calls_t pending_calls_;
+
+	std::unordered_set<http::Client *> postponed_;
+	std::deque<waiting> queue_;  // oldest first, so deadlines are in order too
+	size_t websockets_ = 0;
+
+	crab::Timer drain_timer_;   // queued requests are dispatched from the run loop, never from inside a handler
+	crab::Timer expire_timer_;  // armed for the oldest queued request
+
+	std::atomic<uint64_t> shed_queue_full_{0};
+	std::atomic<uint64_t> shed_timed_out_{0};
+	std::atomic<uint64_t> shed_client_calls_{0};
+	std::atomic<uint64_t> refused_websockets_{0};
+};
+
+}  // namespace schwifty::krabby
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+
+namespace schwifty::krabby {
+
+// monotonic memory for data that lives exactly as long as one request, everything in it is dropped at once
+// when the outermost scope ends. every thread keeps its own arena and recycles it, blocks needed past
+// the initial buffer come from a per-thread pool, so steady traffic does not go to the global heap at all.
+class request_arena {
+public:
+	static constexpr size_t initial_size = 16 * 1024;
+
+	// the arena of the request handled on this thread, throws outside of a scope
+	static std::pmr::memory_resource *current();
+
+	// a copy living in the current arena, throws outside of a scope
+	static std::string_view copy(std::string_view s);
+
+	// scopes nest, inner ones share the arena of the outermost which releases it
+	class scope {
+	public:
+		scope();
+		~scope();
+
+		scope(const scope &) = delete;
+		scope &operator=(const scope &) = delete;
+	};
+
+private:
+	request_arena();
+
+	static request_arena &local();
+
+	std::unique_ptr<std::byte[]> buffer_;
+	std::pmr::unsynchronized_pool_resource blocks_;
+	std::pmr::monotonic_buffer_resource resource_;
+	int depth_ = 0;
+};
+
+template<typename T>
+using arena_allocator = std::pmr::polymorphic_allocator<T>;
+
+}  // namespace schwifty::krabby
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <crab/crab.hpp>
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "client_pool.hpp"
+
+namespace schwifty::krabby {
+
+namespace http = crab::http;
+
+// caches GET responses according to their Cache-Control and ETag/Last-Modified headers.
+// concurrent requests for the same url share a single upstream request.
+class client_cache {
+public:
+	struct settings {
+		size_t max_bytes = 0;  // 0 disables the cache
+	};
+
+	client_cache(client_pool &pool, settings s) : pool_{pool}, settings_{s} {}
+	~client_cache();
+
+	client_cache(const client_cache &) = delete;
+	client_cache &operator=(const client_cache &) = delete;
+
+	std::shared_ptr<client_call> get(
+	    const std::string &url, client_call::r_handler_t &&r_handler, client_call::e_handler_t &&e_handler);
+
+	bool enabled() const { return settings_.max_bytes > 0; }
+	size_t hits() const { return hits_; }
+	size_t misses() const { return misses_; }
+	size_t coalesced() const { return coalesced_; }
+	size_t bytes() const { return bytes_; }
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	struct entry {
+		std::string url;
+		http::Response response;
+		std::string etag;
+		std::string last_modified;
+		clock::time_point expires;
+		size_t bytes = 0;
+	};
+
+	struct flight {
+		std::shared_ptr<client_call> upstream;
+		std::shared_ptr<const entry> stale;  // being revalidated, answers a 304
+		std::list<client_call *> waiters;
+		bool done = false;
+	};
+
+	struct ready {
+		client_call *call;
+		std::shared_ptr<const entry> cached;
+	};
+
+	void join(flight &fl, client_call &call, const std::string &url);
+	void on_response(const std::string &url, http::Response &&resp);
+	void on_error(const std::string &url, std::string &&err);
+	void deliver_ready();
+
+	std::shared_ptr<const entry> lookup(const std::string &url);
+	void insert(std::shared_ptr<const entry> e);
+
+	client_pool &pool_;
+	settings settings_;
+
+	std::list<std::shared_ptr<const entry>> lru_;  // most recently used first
+	std::unordered_map<std::string, std::list<std::shared_ptr<const entry>>::iterator> entries_;
+	std::unordered_map<std::string, std::unique_ptr<flight>> flights_;
+
+	std::list<ready> ready_;  // cache hits are answered on the next loop iteration, like network responses
+	crab::Timer ready_timer_{[this]() { deliver_ready(); }};
+
+	size_t bytes_     = 0;
+	size_t hits_      = 0;
+	size_t misses_    = 0;
+	size_t coalesced_ = 0;
+};
+
+}  // namespace schwifty::krabby
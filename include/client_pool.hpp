@@ -0,0 +1,155 @@
+#pragma once
+
+#include <crab/crab.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "types.hpp"
+
+namespace schwifty::krabby {
+
+namespace http = crab::http;
+
+// a single outgoing request as seen by the caller.
+// the caller owns the call; destroying it cancels the request without invoking any callbacks.
+class client_call {
+public:
+	using r_handler_t = std::function<void(http::Response &&)>;
+	using e_handler_t = std::function<void(std::string &&)>;
+
+	client_call(r_handler_t &&r_handler, e_handler_t &&e_handler)
+	    : r_handler_{std::move(r_handler)}, e_handler_{std::move(e_handler)} {}
+	~client_call() { cancel(); }
+
+	client_call(const client_call &) = delete;
+	client_call &operator=(const client_call &) = delete;
+
+	void cancel();
+	bool is_open() const { return open_; }
+
+private:
+	friend class client_pool;
+	friend class client_cache;
+
+	void complete(http::Response &&resp);
+	void fail(std::string &&err);
+
+	r_handler_t r_handler_;
+	e_handler_t e_handler_;
+	bool open_ = true;
+	std::function<void()> detach_;  // unlinks the call from wherever the pool parked it
+};
+
+// keeps keep-alive connections per host and caches dns results for plain http hosts
+class client_pool {
+public:
+	struct settings {
+		size_t max_idle_per_host = 8;   // idle keep-alive connections kept per host
+		size_t max_per_host      = 32;  // open connections per host, extra requests wait in a queue
+		double idle_timeout      = 15;  // seconds an unused keep-alive connection is kept open
+		double dns_ttl           = 60;  // seconds a resolved address is reused
+	};
+
+	explicit client_pool(settings s) : settings_{s} {}
+	~client_pool();
+
+	client_pool(const client_pool &) = delete;
+	client_pool &operator=(const client_pool &) = delete;
+
+	std::shared_ptr<client_call> send(std::string method, const std::string &url, std::string body,
+	    const kv_map_t &headers, client_call::r_handler_t &&r_handler, client_call::e_handler_t &&e_handler);
+
+	std::shared_ptr<client_call> get(
+	    const std::string &url, client_call::r_handler_t &&r_handler, client_call::e_handler_t &&e_handler) {
+		return send("GET", url, {}, {}, std::move(r_handler), std::move(e_handler));
+	}
+
+	size_t pending() const { return pending_; }
+
+	crab::Handler finished;  // runs whenever a call stops being pending
+
+private:
+	struct target {
+		std::string protocol;
+		std::string host;
+		uint16_t port;
+		std::string uri;  // path with query string
+	};
+
+	struct host_pool;
+
+	struct connection {
+		connection(client_pool &pool, host_pool &host);
+
+		http::ClientConnection conn;
+		crab::Timer idle_timer;
+		host_pool &host;
+		client_call *call = nullptr;         // request currently in flight, nullptr when idle
+		std::optional<http::Request> replay;  // kept for idempotent requests on reused connections
+		size_t served = 0;                    // number of requests completed on this connection
+	};
+
+	struct waiting {
+		client_call *call;
+		http::Request request;
+	};
+
+	struct failed {
+		client_call *call;
+		std::string err;
+	};
+
+	struct dns_entry {
+		crab::Address address;
+		std::chrono::steady_clock::time_point expires;
+	};
+
+	struct host_pool {
+		std::string protocol;
+		std::string host;
+		uint16_t port = 0;
+
+		std::list<std::unique_ptr<connection>> connections;
+		std::list<waiting> queue;
+
+		std::unique_ptr<crab::DNSResolver> resolver;
+		std::optional<dns_entry> dns;  // cached address for plain http hosts
+		bool resolving = false;
+	};
+
+	static target parse_url(const std::string &url);
+
+	void dispatch(host_pool &host, client_call *call, http::Request &&request);
+	void pump(host_pool &host);
+	bool open_connection(host_pool &host);
+	void write(connection &c, client_call *call, http::Request &&request);
+	void on_event(connection &c);
+	void on_resolved(host_pool &host, const std::vector<crab::Address> &names);
+	void release(connection &c);
+	void drop(connection &c);
+	void call_finished();
+	void fail_queue(host_pool &host, const std::string &err);
+	void fail(client_call *call, std::string &&err);
+	void deliver_failed();
+
+	std::optional<crab::Address> cached_address(host_pool &host);
+
+	settings settings_;
+	size_t pending_ = 0;
+	std::unordered_map<std::string, std::unique_ptr<host_pool>> hosts_;
+	std::vector<std::unique_ptr<connection>> closed_;  // dropped connections waiting to be destroyed
+	crab::Timer reap_timer_{[this]() { closed_.clear(); }};
+
+	std::list<failed> failed_;  // error callbacks run on the next loop iteration, never inside send()
+	crab::Timer fail_timer_{[this]() { deliver_failed(); }};
+};
+
+}  // namespace schwifty::krabby
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace schwifty::krabby {
+
+// escapes <>%&#:;'" as decimal html entities (e.g. '<' becomes "&#60;")
+std::string escape_html(std::string_view html);
+
+// the same in two steps for callers bringing their own buffer of escaped_size(html) bytes
+size_t escaped_size(std::string_view html);
+void escape_html_into(std::string_view html, char *out);
+
+// lowercase hex, two characters per byte
+std::string string_to_hex(std::string_view input);
+
+// name of the kernel picked for this cpu: "avx2", "sse2" or "scalar"
+const char *encoding_kernel();
+
+}  // namespace schwifty::krabby
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// plain c entry points for the hottest calls, meant for luajit's ffi (see ffi_cdefs): calls through ffi.C
+// are compiled into traces while calls through the lua c api end them. who and j are the raw pointers of
+// client and json userdata (their "ptr" property). nothing here throws, failures return the fallback.
+extern "C" {
+
+void krabby_respond(void *who, int code, const char *content_type, const char *body, size_t size);
+
+size_t krabby_escaped_size(const char *html, size_t size);
+void krabby_escape_html(const char *html, size_t size, char *out);
+
+int64_t krabby_json_int(const void *j, const char *key, int64_t fallback);
+double krabby_json_number(const void *j, const char *key, double fallback);
+const char *krabby_json_string(const void *j, const char *key, size_t *size);  // nullptr if missing
+void krabby_json_set_int(void *j, const char *key, int64_t value);
+void krabby_json_set_number(void *j, const char *key, double value);
+void krabby_json_set_string(void *j, const char *key, const char *value, size_t size);
+}
+
+namespace schwifty::krabby {
+
+// the declarations above as ffi.cdef takes them
+extern const char *const ffi_cdefs;
+
+}  // namespace schwifty::krabby
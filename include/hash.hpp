@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace schwifty::krabby {
+
+// incremental merkle-damgard hash over 64 byte blocks, the algorithm itself comes from Traits.
+// hashers are plain values: copying one copies its state, nothing is ever allocated.
+template<typename Traits>
+class block_hash {
+public:
+	static constexpr size_t block_size  = 64;
+	static constexpr size_t digest_size = Traits::digest_size;
+	using digest_t                      = std::array<uint8_t, digest_size>;
+
+	block_hash() { init(); }
+
+	void init() {
+		state_    = Traits::initial;
+		buffered_ = 0;
+		length_   = 0;
+	}
+
+	void update(const void *data, size_t size) {
+		auto p = static_cast<const uint8_t *>(data);
+		length_ += size;
+
+		if (buffered_ > 0) {
+			auto n = std::min(size, block_size - buffered_);
+			std::memcpy(buffer_.data() + buffered_, p, n);
+			buffered_ += n;
+			p += n;
+			size -= n;
+
+			if (buffered_ < block_size)
+				return;
+			Traits::compress(state_.data(), buffer_.data());
+			buffered_ = 0;
+		}
+
+		for (; size >= block_size; p += block_size, size -= block_size)
+			Traits::compress(state_.data(), p);
+
+		std::memcpy(buffer_.data(), p, size);
+		buffered_ = size;
+	}
+
+	void update(std::string_view data) { update(data.data(), data.size()); }
+
+	// returns the digest and starts over
+	digest_t final() {
+		auto bits = length_ * 8;
+
+		uint8_t pad[block_size * 2]{0x80};
+		auto pad_size = (buffered_ < block_size - 8 ? block_size : block_size * 2) - buffered_;
+		for (size_t i = 0; i < 8; ++i)
+			pad[pad_size - 1 - i] = static_cast<uint8_t>(bits >> (8 * i));
+		update(pad, pad_size);
+
+		digest_t digest;
+		for (size_t i = 0; i < digest_size / 4; ++i) {
+			digest[i * 4]     = static_cast<uint8_t>(state_[i] >> 24);
+			digest[i * 4 + 1] = static_cast<uint8_t>(state_[i] >> 16);
+			digest[i * 4 + 2] = static_cast<uint8_t>(state_[i] >> 8);
+			digest[i * 4 + 3] = static_cast<uint8_t>(state_[i]);
+		}
+
+		init();
+		return digest;
+	}
+
+private:
+	std::array<uint32_t, digest_size / 4> state_;
+	std::array<uint8_t, block_size> buffer_;
+	size_t buffered_;
+	uint64_t length_;  // in bytes
+};
+
+struct sha1_traits {
+	static constexpr size_t digest_size = 20;
+	static constexpr std::array<uint32_t, 5> initial{0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+	static void compress(uint32_t *state, const uint8_t *block);
+};
+
+struct sha256_traits {
+	static constexpr size_t digest_size = 32;
+	static constexpr std::array<uint32_t, 8> initial{
+	    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+	static void compress(uint32_t *state, const uint8_t *block);
+};
+
+using sha1   = block_hash<sha1_traits>;
+using sha256 = block_hash<sha256_traits>;
+
+// hmac with the padded key hashed once upfront, so signing with the same secret
+// again only costs hashing the message and two copies of the precomputed states
+template<typename Hash>
+class hmac {
+public:
+	using digest_t = typename Hash::digest_t;
+
+	explicit hmac(std::string_view key) {
+		std::array<uint8_t, Hash::block_size> pad{};
+		if (key.size() > Hash::block_size) {
+			Hash h;
+			h.update(key);
+			auto digest = h.final();
+			std::memcpy(pad.data(), digest.data(), digest.size());
+		} else {
+			std::memcpy(pad.data(), key.data(), key.size());
+		}
+
+		for (auto &b : pad)
+			b ^= 0x36;
+		inner_start_.update(pad.data(), pad.size());
+
+		for (auto &b : pad)
+			b ^= 0x36 ^ 0x5c;
+		outer_start_.update(pad.data(), pad.size());
+
+		inner_ = inner_start_;
+	}
+
+	void init() { inner_ = inner_start_; }
+	void update(const void *data, size_t size) { inner_.update(data, size); }
+	void update(std::string_view data) { inner_.update(data); }
+
+	// returns the mac and starts over with the same key
+	digest_t final() {
+		auto inner = inner_.final();
+		auto outer = outer_start_;
+		outer.update(inner.data(), inner.size());
+
+		init();
+		return outer.final();
+	}
+
+private:
+	Hash inner_start_;
+	Hash outer_start_;
+	Hash inner_;
+};
+
+template<typename Digest>
+inline std::string digest_to_string(const Digest &digest) {
+	return std::string{reinterpret_cast<const char *>(digest.data()), digest.size()};
+}
+
+// raw digest bytes
+std::string hash_sha1(std::string_view data);
+std::string hash_sha256(std::string_view data);
+
+// hex encoded macs
+std::string hmac_sha1(std::string_view msg, std::string_view key);
+std::string hmac_sha256(std::string_view msg, std::string_view key);
+
+}  // namespace schwifty::krabby
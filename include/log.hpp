@@ -1,7 +1,21 @@
 #pragma once
 
 #include <fmt/format.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <iterator>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
 
 namespace schwifty::logger {
 
@@ -11,11 +25,15 @@ inline constexpr bool EnableLog = true;
 inline constexpr bool EnableLog = false;
 #endif
 
-enum class loglevel : int8_t { fatal = 0, warning, info, debug, trace };
+enum class loglevel : int8_t { fatal = 0, warning, info, debug, trace, access };
 
+// lines go into a lock-free ring owned by the calling thread and are written to stderr in batches by a
+// background thread. lines are dropped (and counted) when a ring is full. numbers and strings are copied
+// into the ring and formatted by the background thread, so format strings have to be literals. lines
+// with arguments of any other type are formatted right away.
 class log {
 private:
-	log() : enable_(false), level_(loglevel::info) {}
+	log() : enable_(false), access_(false), level_(loglevel::info) {}
 
 public:
 	log(const log &) = delete;
@@ -23,10 +41,25 @@ public:
 	log(log &&)                 = delete;
 	log &operator=(log &&) = delete;
 
-	inline static void enable(bool enable) { instance().enable_ = enable; }
+	~log() { stop(); }
+
+	inline static void enable(bool enable) {
+		instance().enable_ = enable;
+		if (enable)
+			instance().start();
+	}
 	inline static bool enabled() { return instance().enable_; }
 	inline static void level(loglevel level) { instance().level_ = level; }
 	inline static loglevel level() { return instance().level_; }
+	inline static uint64_t dropped() { return instance().dropped_.load(std::memory_order_relaxed); }
+
+	// access log lines are written regardless of the log level and even without ENABLE_LOG
+	inline static void access_log(bool enable) {
+		instance().access_ = enable;
+		if (enable)
+			instance().start();
+	}
+	inline static bool access_log() { return instance().access_; }
 
 	template<typename... Args>
 	static void trace(const char *format, const Args &... args) {
@@ -57,23 +90,250 @@ public:
 		instance().dump(loglevel::fatal, format, args...);
 	}
 
+	// one compact line per request: method, path, status, latency, bytes and the handling route or mountpoint
+	static void access(std::string_view method, std::string_view path, int status, uint64_t latency_us,
+	    size_t bytes, std::string_view handler) {
+		auto &self = instance();
+		if (!self.access_)
+			return;
+
+		auto l = self.local().acquire();
+		if (!l) {
+			self.dropped_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		self.push(loglevel::access, "{} {} {} {}us {}B \"{}\"", method, path, status, latency_us, bytes, handler);
+	}
+
 private:
+	struct line;
+	using formatter_t = void (*)(std::string &out, const line &l);
+
+	struct line {
+		loglevel level;
+		std::string text;  // keeps its capacity when the slot is reused
+		const char *format    = nullptr;
+		formatter_t formatter = nullptr;  // set when the arguments were captured instead of formatted
+		alignas(std::max_align_t) std::array<unsigned char, 96> args;
+	};
+
+	// a string argument, copied into the line text
+	struct slice {
+		size_t at;
+		size_t size;
+	};
+
+	template<typename T>
+	static constexpr bool is_string = std::is_convertible_v<const T &, std::string_view>;
+
+	template<typename T>
+	using captured_t = std::conditional_t<is_string<T>, slice, T>;
+
+	template<typename... Args>
+	static constexpr bool deferrable = (... && (std::is_arithmetic_v<Args> || is_string<Args>)) &&
+	                                   sizeof(std::tuple<captured_t<Args>...>) <= sizeof(line::args);
+
+	template<typename T>
+	static captured_t<T> capture(line &l, const T &value) {
+		if constexpr (is_string<T>) {
+			std::string_view s{value};
+			slice at{l.text.size(), s.size()};
+			l.text.append(s);
+			return at;
+		} else {
+			return value;
+		}
+	}
+
+	template<typename T>
+	static auto restore(const line &l, const T &value) {
+		if constexpr (std::is_same_v<T, slice>)
+			return std::string_view{l.text}.substr(value.at, value.size);
+		else
+			return value;
+	}
+
+	template<typename... Captured>
+	static void format_captured(std::string &out, const line &l) {
+		auto &captured = *std::launder(reinterpret_cast<const std::tuple<Captured...> *>(l.args.data()));
+		auto values    = std::apply([&l](const auto &... c) { return std::make_tuple(restore(l, c)...); }, captured);
+		std::apply([&](const auto &... v) {
+			fmt::vformat_to(std::back_inserter(out), l.format, fmt::make_format_args(v...));
+		}, values);
+	}
+
+	// single producer, single consumer
+	class ring {
+	public:
+		static constexpr size_t capacity = 1024;
+
+		line *acquire() {
+			auto head = head_.load(std::memory_order_relaxed);
+			if (head - tail_.load(std::memory_order_acquire) == capacity)
+				return nullptr;
+			return &lines_[head % capacity];
+		}
+
+		// returns the number of lines waiting to be written
+		size_t commit() {
+			auto head = head_.load(std::memory_order_relaxed) + 1;
+			head_.store(head, std::memory_order_release);
+			return head - tail_.load(std::memory_order_relaxed);
+		}
+
+		template<typename F>
+		size_t drain(F &&f) {
+			auto tail = tail_.load(std::memory_order_relaxed);
+			auto head = head_.load(std::memory_order_acquire);
+			for (auto i = tail; i != head; ++i)
+				f(lines_[i % capacity]);
+			tail_.store(head, std::memory_order_release);
+			return head - tail;
+		}
+
+	private:
+		std::array<line, capacity> lines_;
+		std::atomic<size_t> head_{0};
+		std::atomic<size_t> tail_{0};
+	};
+
 	static log &instance() {
 		static log log;
 		return log;
 	}
 
+	ring &local() {
+		static thread_local std::shared_ptr<ring> local = [this]() {
+			auto r = std::make_shared<ring>();
+			auto g = std::lock_guard(rings_m_);
+			rings_.push_back(r);
+			return r;
+		}();
+		return *local;
+	}
+
 	template<typename... Args>
 	void dump(loglevel level, const char *format, const Args &... args) {
 		if (enable_ && level_ >= level) {
+			if (level == loglevel::fatal) {
+				// nothing is lost on the way out
+				auto g = std::lock_guard(m_);
+				flush();
+				fmt::print(stderr, "[{}] ", prefix_for(level));
+				fmt::vprint(stderr, format, fmt::make_format_args(args...));
+				fmt::print(stderr, "\n");
+				return;
+			}
+
+			push(level, format, args...);
+		}
+	}
+
+	template<typename... Args>
+	void push(loglevel level, const char *format, const Args &... args) {
+		auto l = local().acquire();
+		if (!l) {
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		l->level = level;
+		l->text.clear();
+		if constexpr (deferrable<Args...>) {
+			using captured = std::tuple<captured_t<Args>...>;
+			static_assert(std::is_trivially_destructible_v<captured>);
+
+			l->format    = format;
+			l->formatter = &format_captured<captured_t<Args>...>;
+			new (l->args.data()) captured{capture(*l, args)...};
+		} else {
+			l->formatter = nullptr;
+			fmt::vformat_to(std::back_inserter(l->text), format, fmt::make_format_args(args...));
+		}
+		committed();
+	}
+
+	void committed() {
+		if (local().commit() == ring::capacity / 2)
+			cv_.notify_one();  // don't wait for the next flush when lines come in fast
+	}
+
+	void format(const line &l) {
+		if (!l.formatter) {
+			batch_.append(l.text);
+			return;
+		}
+
+		auto size = batch_.size();
+		try {
+			l.formatter(batch_, l);
+		} catch (const std::exception &e) {
+			batch_.resize(size);
+			batch_.append(fmt::format("bad log line '{}': {}", l.format, e.what()));
+		}
+	}
+
+	void start() {
+		auto g = std::lock_guard(m_);
+		if (!flusher_.joinable())
+			flusher_ = std::thread([this]() { run(); });
+	}
+
+	void stop() {
+		{
 			auto g = std::lock_guard(m_);
-			fmt::print(stderr, "[{}] ", prefix_for(level));
-			fmt::vprint(stderr, format, fmt::make_format_args(args...));
-			fmt::print(stderr, "\n");
+			stop_  = true;
+		}
+		cv_.notify_one();
+		if (flusher_.joinable())
+			flusher_.join();
+	}
+
+	void run() {
+		auto lock = std::unique_lock(m_);
+		while (!stop_) {
+			if (flush() == 0)
+				cv_.wait_for(lock, std::chrono::milliseconds(10));
+		}
+		flush();
+	}
+
+	// expects m_ to be held, writes everything buffered so far with a single write
+	size_t flush() {
+		{
+			// threads registering their first line must not wait for the write below
+			auto g = std::lock_guard(rings_m_);
+			flushing_.assign(rings_.begin(), rings_.end());
+		}
+
+		batch_.clear();
+		size_t count{0};
+		for (auto &r : flushing_) {
+			count += r->drain([this](const line &l) {
+				batch_.push_back('[');
+				batch_.append(prefix_for(l.level));
+				batch_.append("] ");
+				format(l);
+				batch_.push_back('\n');
+			});
+		}
+
+		auto dropped = dropped_.load(std::memory_order_relaxed);
+		if (dropped != reported_) {
+			fmt::format_to(std::back_inserter(batch_), "[{}] {} log lines dropped\n", prefix_for(loglevel::warning),
+			    dropped - reported_);
+			reported_ = dropped;
+		}
+
+		if (!batch_.empty()) {
+			std::fwrite(batch_.data(), 1, batch_.size(), stderr);
+			std::fflush(stderr);
 		}
+		return count;
 	}
 
-	inline std::string prefix_for(loglevel level) {
+	inline const char *prefix_for(loglevel level) {
 		switch (level) {
 		case loglevel::fatal:
 			return "X_X";
@@ -85,13 +345,26 @@ private:
 			return ">_<";
 		case loglevel::trace:
 			return "T.T";
+		case loglevel::access:
+			return "@.@";
 		default:
 			return "?.?";
 		}
 	}
 
 	bool enable_;
+	bool access_;
 	loglevel level_;
-	std::mutex m_;
+	std::mutex m_;  // guards stderr and the flusher, never taken while logging a line
+	std::condition_variable cv_;
+	std::thread flusher_;
+	bool stop_ = false;
+
+	std::mutex rings_m_;                        // guards the ring list, taken by a thread's first line
+	std::vector<std::shared_ptr<ring>> rings_;  // kept after their threads are gone
+	std::vector<std::shared_ptr<ring>> flushing_;
+	std::string batch_;
+	std::atomic<uint64_t> dropped_{0};
+	uint64_t reported_ = 0;
 };
-}  // namespace schwifty::logger
\ No newline at end of file
+}  // namespace schwifty::logger
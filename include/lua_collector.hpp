@@ -0,0 +1,63 @@
+#pragma once
+
+#include <crab/crab.hpp>
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+#include "lua_compat.hpp"
+
+namespace schwifty::krabby {
+
+// tunes the collector of the lua states and moves collection work out of the request path: whenever
+// the run loop has nothing else to do, incremental steps run for at most idle_budget per tick until
+// a cycle is complete. the generational collector never reports a complete cycle, so there a single
+// young collection runs instead. handled requests start it again.
+// lua has no hook around its own collection work, so only the time of idle steps can be measured.
+// completed cycles (all collections in generational mode) are counted everywhere through a finalizer,
+// the difference ran in the request path.
+class lua_collector {
+public:
+	struct settings {
+		std::string mode   = "incremental";  // or "generational", lua 5.4 only
+		int pause          = 0;              // percent the heap grows before a new cycle, 0 keeps lua's default
+		int stepmul        = 0;              // collection speed relative to allocation, 0 keeps lua's default
+		double idle_budget = 0.001;          // seconds of collection per idle tick, 0 disables idle collection
+	};
+
+	using state_t = std::function<lua_State *()>;
+
+	lua_collector(settings s, state_t &&state);
+
+	lua_collector(const lua_collector &) = delete;
+	lua_collector &operator=(const lua_collector &) = delete;
+
+	// applies mode and parameters to a freshly created state and starts counting its cycles
+	void configure(lua_State *L);
+
+	// there is new garbage, collect it the next time the loop is idle
+	void touch();
+
+	double seconds() const { return static_cast<double>(nanoseconds_.load(std::memory_order_relaxed)) / 1e9; }
+	uint64_t cycles() const { return cycles_.load(std::memory_order_relaxed); }
+	uint64_t all_cycles() const { return all_cycles_.load(std::memory_order_relaxed); }
+
+private:
+	void step();
+
+	static void arm(lua_State *L, lua_collector *self);  // an unreferenced object finalized by the next collection
+	static int collected(lua_State *L);
+
+	settings settings_;
+	state_t state_;
+	crab::Idle idle_;
+	bool active_       = false;
+	bool generational_ = false;
+
+	std::atomic<uint64_t> nanoseconds_{0};  // spent in idle steps
+	std::atomic<uint64_t> cycles_{0};       // completed by idle steps, young collections in generational mode
+	std::atomic<uint64_t> all_cycles_{0};   // idle or not, young collections too in generational mode
+};
+
+}  // namespace schwifty::krabby
@@ -0,0 +1,18 @@
+#pragma once
+
+// the lua c api krabby uses directly, from luajit when built with USE_LUAJIT.
+// sol2 papers over the rest once SOL_LUAJIT is defined (cmake does both).
+#include <lua.hpp>
+#ifdef USE_LUAJIT
+#include <luajit.h>
+#endif
+
+namespace schwifty::krabby {
+
+#ifdef USE_LUAJIT
+inline constexpr bool UseLuaJit = true;
+#else
+inline constexpr bool UseLuaJit = false;
+#endif
+
+}  // namespace schwifty::krabby
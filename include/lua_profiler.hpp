@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "lua_compat.hpp"
+
+namespace schwifty::krabby {
+
+// watches lua route handlers through a count hook: samples their stacks into collapsed stacks
+// (one "route;outer;inner count" line per stack, as flamegraph.pl takes them) and aborts handlers
+// that run over their instruction or time budget. without a budget and with sampling off no hook
+// is installed and handlers run at full speed. luajit does not call hooks from compiled traces,
+// so there only the interpreted parts of a handler are sampled and checked.
+// the abort is a lua error, which longjmps. while a c++ binding that called back into lua is on the stack
+// the abort waits for it to return, so the budget can be overrun by the time spent in there.
+class lua_profiler {
+public:
+	struct settings {
+		uint64_t instruction_budget = 0;  // per handler call, 0 is unlimited
+		double time_budget          = 0;  // seconds per handler call, 0 is unlimited
+		uint64_t sample_interval    = 0;  // instructions between stack samples, 0 disables sampling
+	};
+
+	explicit lua_profiler(settings s);
+
+	lua_profiler(const lua_profiler &) = delete;
+	lua_profiler &operator=(const lua_profiler &) = delete;
+
+	// can be changed while serving, takes effect with the next handler call
+	void start(uint64_t sample_interval);
+	void stop() { start(0); }
+	bool sampling() const { return sample_interval_ > 0; }
+
+	std::string dump() const;  // collapsed stacks
+	void reset();
+
+	uint64_t aborted() const { return aborted_.load(std::memory_order_relaxed); }
+
+	// hooks the state for the duration of one handler call
+	class scope {
+	public:
+		scope(lua_profiler &profiler, lua_State *L, std::string_view route);
+		~scope();
+
+		scope(const scope &) = delete;
+		scope &operator=(const scope &) = delete;
+
+	private:
+		friend class lua_profiler;
+
+		lua_profiler &profiler_;
+		lua_State *L_;
+		std::string_view route_;
+		scope *previous_;
+		bool hooked_           = false;
+		const char *over_      = nullptr;  // the budget that ran out, the abort waits for a safe point
+		int count_             = 0;  // instructions between hook calls
+		uint64_t instructions_ = 0;
+		uint64_t since_sample_ = 0;
+		std::chrono::steady_clock::time_point deadline_;
+	};
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	static constexpr int check_interval = 1000;  // instructions between budget checks
+
+	static void hook(lua_State *L, lua_Debug *ar);
+	void sample(lua_State *L, const scope &s);
+
+	settings settings_;
+	std::atomic<uint64_t> sample_interval_;
+	std::atomic<uint64_t> aborted_{0};
+
+	mutable std::mutex m_;  // dump may be called from anywhere
+	std::unordered_map<std::string, uint64_t> stacks_;
+};
+
+}  // namespace schwifty::krabby
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace schwifty::krabby {
+
+#ifdef ENABLE_METRICS
+inline constexpr bool EnableMetrics = true;
+#else
+inline constexpr bool EnableMetrics = false;
+#endif
+
+// counters are only ever written by the thread owning them, readers see relaxed snapshots
+inline void bump(std::atomic<uint64_t> &counter, uint64_t n = 1) {
+	counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// log-linear histogram of microseconds with 8 sub buckets per power of two (~12% precision)
+class histogram {
+public:
+	static constexpr size_t sub_bits = 3;
+	static constexpr size_t sub      = size_t{1} << sub_bits;
+	static constexpr size_t buckets  = (40 - sub_bits + 1) * sub;  // up to 2^40us, about 12 days
+
+	void record(uint64_t us) {
+		bump(counts_[bucket_for(us)]);
+		bump(sum_, us);
+		bump(count_);
+	}
+
+	static size_t bucket_for(uint64_t v) {
+		if (v < sub)
+			return v;
+		auto shift = 63 - __builtin_clzll(v) - sub_bits;
+		auto index = (shift + 1) * sub + ((v >> shift) & (sub - 1));
+		return std::min<size_t>(index, buckets - 1);
+	}
+
+	// exclusive upper bound of the values counted in a bucket
+	static uint64_t upper_bound(size_t bucket) {
+		if (bucket < sub)
+			return bucket + 1;
+		return (sub + bucket % sub + 1) << (bucket / sub - 1);
+	}
+
+private:
+	friend class metrics;
+
+	std::array<std::atomic<uint64_t>, buckets> counts_{};
+	std::atomic<uint64_t> sum_{0};
+	std::atomic<uint64_t> count_{0};
+};
+
+struct endpoint_stats {
+	std::atomic<uint64_t> requests{0};
+	std::atomic<uint64_t> errors{0};  // handlers that threw or reported a failure
+	std::atomic<uint64_t> bytes_out{0};
+	std::array<std::atomic<uint64_t>, 6> status{};  // by class, index 0 counts anything outside 1xx-5xx
+	histogram latency;
+};
+
+// per-thread request metrics exposed in prometheus text format
+class metrics {
+public:
+	using gauge_t = std::function<double()>;
+
+	metrics(const metrics &) = delete;
+	metrics &operator=(const metrics &) = delete;
+
+	// stats are created on first use and live as long as the process, so callers can keep the pointers
+	static endpoint_stats *server() { return EnableMetrics ? find("server", "") : nullptr; }
+	static endpoint_stats *route(const std::string &name) { return EnableMetrics ? find("route", name) : nullptr; }
+	static endpoint_stats *mount(const std::string &name) { return EnableMetrics ? find("mount", name) : nullptr; }
+	static endpoint_stats *storage(const std::string &op) { return EnableMetrics ? find("storage", op) : nullptr; }
+
+	// counts a response written while handling the innermost scope on this thread, and keeps it for the access log
+	static void response(int status, size_t bytes);
+
+	// names the route or mountpoint that took the request handled on this thread
+	static void handled_by(std::string_view handler);
+
+	// the request handled on this thread will be answered later
+	static void postponed();
+
+	// the request handled on this thread waits in the admission queue, the scope it is dispatched in counts it
+	static void queued();
+
+	// true once the request handled on this thread got its response or was postponed
+	static bool answered();
+
+	// the handler running on this thread failed without throwing, counted as an error of the innermost scope
+	// and of the request
+	static void failed();
+
+	static void gauge(std::string name, std::string help, gauge_t &&value);
+	static void counter(std::string name, std::string help, gauge_t &&value);  // a value that only ever grows
+	static std::string prometheus();
+
+	// measures a request (or any operation) from construction until destruction
+	class scope {
+	public:
+		explicit scope(endpoint_stats *stats) : stats_{stats} {
+			if constexpr (EnableMetrics) {
+				if (stats_) {
+					previous_   = current();
+					current()   = stats_;
+					exceptions_ = std::uncaught_exceptions();
+					start_      = std::chrono::steady_clock::now();
+				}
+			}
+		}
+
+		~scope() {
+			if constexpr (EnableMetrics) {
+				if (stats_) {
+					auto elapsed = std::chrono::steady_clock::now() - start_;
+					bump(stats_->requests);
+					if (std::uncaught_exceptions() > exceptions_)
+						bump(stats_->errors);
+					stats_->latency.record(
+					    std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+					current() = previous_;
+				}
+			}
+		}
+
+		scope(const scope &) = delete;
+		scope &operator=(const scope &) = delete;
+
+	private:
+		endpoint_stats *stats_;
+		endpoint_stats *previous_ = nullptr;
+		int exceptions_           = 0;
+		std::chrono::steady_clock::time_point start_;
+	};
+
+	// the outermost scope of a request: measured against the given stats like any scope, and described
+	// in the access log with what the handlers below reported through response() and handled_by()
+	class request {
+	public:
+		// start is the arrival of a request dispatched from the queue, now for any other
+		request(endpoint_stats *stats, std::string_view method, std::string_view path,
+		    std::chrono::steady_clock::time_point start = {});
+		~request();
+
+		request(const request &) = delete;
+		request &operator=(const request &) = delete;
+
+	private:
+		friend class metrics;
+
+		endpoint_stats *stats_;
+		std::string_view method_;
+		std::string_view path_;
+		std::string_view handler_;  // route or mountpoint that took the request
+		int status_     = 0;        // stays 0 while the response is postponed
+		size_t bytes_   = 0;
+		bool postponed_ = false;
+		bool failed_    = false;
+		bool queued_    = false;
+
+		request *previous_              = nullptr;
+		endpoint_stats *previous_stats_ = nullptr;
+		bool logged_;
+		int exceptions_;
+		std::chrono::steady_clock::time_point start_;
+	};
+
+private:
+	metrics() = default;
+
+	struct named_stats {
+		std::string kind;
+		std::string name;
+		endpoint_stats stats;
+	};
+
+	struct shard {
+		std::mutex m;  // taken by the owning thread only to add stats, and by scrapes
+		std::unordered_map<std::string, std::unique_ptr<named_stats>> stats;
+	};
+
+	struct gauge_entry {
+		std::string name;
+		std::string help;
+		gauge_t value;
+		const char *type;  // gauge or counter
+	};
+
+	static metrics &instance() {
+		static metrics m;
+		return m;
+	}
+
+	static endpoint_stats *&current() {
+		static thread_local endpoint_stats *current = nullptr;
+		return current;
+	}
+
+	static request *&current_request() {
+		static thread_local request *current = nullptr;
+		return current;
+	}
+
+	static shard &local();
+	static endpoint_stats *find(const char *kind, const std::string &name);
+
+	std::mutex m_;
+	std::vector<std::shared_ptr<shard>> shards_;  // kept after their threads are gone
+	std::vector<gauge_entry> gauges_;
+};
+
+}  // namespace schwifty::krabby
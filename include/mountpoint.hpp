@@ -3,7 +3,10 @@
 #include <crab/crab.hpp>
 #include <filesystem>
 #include <fstream>
+#include "arena.hpp"
 #include "log.hpp"
+#include "metrics.hpp"
+#include "types.hpp"
 #include "util.hpp"
 
 namespace schwifty::krabby {
@@ -13,27 +16,36 @@ namespace http = crab::http;
 
 class mountpoint {
 public:
-	mountpoint(std::string point, std::filesystem::path path) : point_{point}, path_{path} {
+	mountpoint(std::string point, std::filesystem::path path)
+	    : point_{point}, path_{path}, stats_{metrics::mount(point)} {
 		log::info("creating mountpoint '{}' -> '{}'", point, path_.string());
 	}
 
 	bool handle(http::Client *who, http::Request &request) {
-		log::trace("checking point '{}' vs path '{}'", point_, request.header.path.substr(0, point_.size()));
-		if (request.header.path.substr(0, point_.size()) == point_) {
-			auto path = request.header.path.substr(point_.size());
-			path      = remove_leading_slash(path);
-
-			auto ext       = std::string{"txt"};  // assume txt by default
+		// every request passes through here, so nothing is copied until the point matches
+		std::string_view requested{request.header.path};
+		log::trace("checking point '{}' vs path '{}'", point_, requested.substr(0, point_.size()));
+		if (requested.substr(0, point_.size()) == point_) {
+			metrics::scope scope{stats_};
+			metrics::handled_by(point_);
+			request_arena::scope arena;
+
+			auto path = requested.substr(point_.size());
+			if (!path.empty() && path.front() == '/')
+				path.remove_prefix(1);
+
+			std::pmr::string ext{"txt", request_arena::current()};  // assume txt by default
 			auto ext_start = path.find_last_of('.');
-			if (ext_start != std::string::npos) {
-				ext = str_tolower(path.substr(ext_start + 1));
+			if (ext_start != std::string_view::npos) {
+				ext.assign(path.substr(ext_start + 1));
+				std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
 			}
 
 			auto [mime, mime_params] = mime_type_for(ext);
-			log::info("mime-type detected as '{}'", mime);
+			log::trace("mime-type detected as '{}'", mime);
 
 			auto p = (path_ / path).string();
-			log::info("handling path: '{}' -> '{}'", path, p);
+			log::debug("handling path: '{}' -> '{}'", path, p);
 
 			try {
 				http::Response r;
@@ -41,11 +53,12 @@ public:
 				r.header.set_content_type(mime, mime_params);
 				r.set_body(read_file(p));
 
+				metrics::response(200, r.body.size());
 				who->write(std::move(r));
 
-				log::info("file handled from path '{}'", p);
 			} catch (std::runtime_error &err) {
 				log::warn("could not get file from path '{}'", p);
+				metrics::response(404, 0);
 				who->write(http::Response::simple_html(404));
 			}
 
@@ -55,8 +68,7 @@ public:
 		return false;
 	}
 
-private:
-	std::tuple<std::string, std::string> mime_type_for(std::string_view ext) {
+	static std::tuple<std::string, std::string> mime_type_for(std::string_view ext) {
 		if (ext == "html" || ext == "htm") {
 			return {"text/html", "charset=utf-8"};
 		}
@@ -79,6 +91,7 @@ private:
 		return {"text/plain", "charset=utf-8"};
 	}
 
+private:
 	// todo: rewrite to use a file wrapper once hrissan makes one for crablib
 	std::string read_file(std::filesystem::path filepath) {
 		std::ifstream ifs(filepath, std::ios::binary | std::ios::ate);
@@ -107,6 +120,7 @@ private:
 
 	std::string point_;
 	std::filesystem::path path_;
+	endpoint_stats *stats_;
 };
 
 }  // namespace schwifty::krabby
\ No newline at end of file
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <new>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "arena.hpp"
+#include "types.hpp"
+
+namespace schwifty::krabby {
+
+// submatches of the route that took the request: the whole path first, then the groups, empty when they did not
+// take part. the views are copied into the request arena and point into the request.
+class route_match {
+public:
+	route_match() = default;
+
+	template<typename Match>
+	explicit route_match(const Match &m) : size_{m.size()} {
+		if (size_ == 0)
+			return;
+
+		auto groups = static_cast<std::string_view *>(
+		    request_arena::current()->allocate(size_ * sizeof(std::string_view), alignof(std::string_view)));
+		for (size_t i = 0; i < size_; ++i) {
+			new (groups + i) std::string_view{
+			    m[i].matched ? std::string_view{m[i].first, static_cast<size_t>(m[i].length())} : std::string_view{}};
+		}
+		groups_ = groups;
+	}
+
+	size_t size() const { return size_; }
+	std::string_view operator[](size_t i) const { return groups_[i]; }
+
+private:
+	const std::string_view *groups_ = nullptr;
+	size_t size_                    = 0;
+};
+
+// query strings escape with %XX and '+' for spaces
+inline bool needs_url_decode(std::string_view in) { return in.find_first_of("%+") != std::string_view::npos; }
+
+// query string parameters, split on first use. keys and values point into the query string
+// and are only decoded when they contain escapes. for repeated keys the last value wins.
+class query_params {
+public:
+	struct entry {
+		std::string_view key;    // still encoded
+		std::string_view value;  // still encoded
+	};
+
+	void reset(std::string_view query) {
+		query_   = query;
+		parsed_  = false;
+		decoded_ = false;
+		entries_.clear();  // keeps the capacity for the next request
+		unique_.clear();
+	}
+
+	bool has(std::string_view key) { return find(key).has_value(); }
+	std::optional<std::string_view> find(std::string_view key);  // the raw value
+	std::optional<std::string_view> get(std::string_view key);   // the decoded value
+
+	// decoded entries in query order, a repeated key only once with the value that wins. built on first use
+	const std::vector<entry> &unique_entries();
+
+	// compares an encoded key with a decoded one without decoding it first
+	static bool key_equals(std::string_view encoded, std::string_view key);
+
+	// the text itself when there is nothing to decode, otherwise a decoded copy in the request arena
+	static std::string_view decode(std::string_view encoded);
+
+private:
+	void parse();
+
+	std::string_view query_;
+	bool parsed_  = false;
+	bool decoded_ = false;
+	std::vector<entry> entries_;
+	std::vector<entry> unique_;
+};
+
+// lua gets these instead of tables, they resolve through request_view and only work while the handler runs
+struct matches_handle {
+	uint64_t generation;
+};
+struct params_handle {
+	uint64_t generation;
+};
+
+// regex matches and query parameters of the request routed on this thread. both point into the request,
+// so handles given out for one request stop working once its handler returns.
+class request_view {
+public:
+	static request_view &current() {
+		static thread_local request_view view;
+		return view;
+	}
+
+	// binds a matched request for as long as the scope lives
+	class scope {
+	public:
+		scope(const route_match &matches, std::string_view query) {
+			auto &view = current();
+			++view.generation_;
+			view.matches_ = &matches;
+			view.params_.reset(query);
+		}
+
+		~scope() {
+			auto &view = current();
+			++view.generation_;
+			view.matches_ = nullptr;
+			view.params_.reset({});
+		}
+
+		scope(const scope &) = delete;
+		scope &operator=(const scope &) = delete;
+	};
+
+	query_params &params() { return params_; }
+
+	// handles for the request bound right now
+	matches_handle matches_ref() const { return {generation_}; }
+	params_handle params_ref() const { return {generation_}; }
+
+	// throw when the handle outlived its request
+	const route_match &matches(const matches_handle &h) const;
+	query_params &params(const params_handle &h);
+
+private:
+	uint64_t generation_        = 0;
+	const route_match *matches_     = nullptr;
+	query_params params_;
+};
+
+}  // namespace schwifty::krabby
@@ -4,10 +4,13 @@
 
 #include <functional>
 #include <map>
+#include <memory_resource>
 #include <regex>
 #include <set>
 #include <unordered_map>
 
+#include "metrics.hpp"
+#include "request_view.hpp"
 #include "types.hpp"
 #include "util.hpp"
 
@@ -17,12 +20,14 @@ namespace http = crab::http;
 
 class router {
 public:
-	using route_t  = std::function<void(http::Client *, http::Request &, std::cmatch &, kv_map_t &)>;
+	using route_t  = std::function<void(http::Client *, http::Request &, route_match &, query_params &)>;
 	using fields_t = std::set<std::string>;
 
 	struct route {
+		std::string name;  // method and regex
 		route_t handler;
 		fields_t mandatory_fields;
+		endpoint_stats *stats;
 	};
 
 	using route_table_t = std::vector<std::tuple<std::regex, route>>;
@@ -50,6 +55,11 @@ private:
 
 	// routes are grouped per Method (POST, GET, etc.)
 	std::map<std::string, route_table_t> routes_;
+
+	// regex_match takes its scratch vectors from the allocator of the results. candidates are matched
+	// out of a pool that keeps recycling the same blocks, only the winner is copied into the request arena.
+	std::pmr::unsynchronized_pool_resource match_pool_;
+	std::match_results<const char *, std::pmr::polymorphic_allocator<std::csub_match>> candidate_{&match_pool_};
 };
 
 }  // namespace schwifty::krabby
\ No newline at end of file
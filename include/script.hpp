@@ -3,8 +3,14 @@
 #include <crab/crab.hpp>
 #include <filesystem>
 #include <sol/sol.hpp>
+#include "client_cache.hpp"
+#include "client_pool.hpp"
+#include "lua_collector.hpp"
+#include "lua_profiler.hpp"
 #include "mountpoint.hpp"
 #include "router.hpp"
+#include "shared_cache.hpp"
+#include "timer_wheel.hpp"
 
 namespace schwifty::krabby {
 
@@ -12,12 +18,20 @@ namespace http = crab::http;
 
 class script_engine {
 public:
-	explicit script_engine(std::filesystem::path path);
+	struct settings {
+		lua_profiler::settings profiling{};
+		shared_cache::settings cache{};
+		lua_collector::settings gc{};
+	};
+
+	explicit script_engine(std::filesystem::path path, settings s = {});
 	void reload();
 
 	bool handle_route(http::Client *who, http::Request &request);
 	bool handle_mountpoint(http::Client *who, http::Request &request);
 
+	static void register_json(sol::state &lua);
+
 private:
 	struct scripting_context {
 		sol::state lua_;  // lifetime is longer than router and mountpoints
@@ -37,7 +51,11 @@ private:
 	void load_extensions(std::filesystem::path path);
 
 	std::filesystem::path path_;
+	lua_profiler profiler_;  // shared by all contexts, so samples survive a reload
+	shared_cache cache_;     // the lua "cache" global, shared by all contexts so it stays warm across reloads
+	lua_collector gc_;       // collects garbage of the master context while the loop is idle
 	crab::Timer swap_timer_;
+	timer_wheel timers_;  // shared by all contexts, outlives the timers created from lua
 	std::shared_ptr<scripting_context> staging_ctx_;
 	std::shared_ptr<scripting_context> master_ctx_;
 };
@@ -8,8 +8,10 @@
 #include <crab/crab.hpp>
 #include <inja/inja.hpp>
 
+#include "admission.hpp"
 #include "database.hpp"
 #include "log.hpp"
+#include "metrics.hpp"
 #include "mountpoint.hpp"
 #include "router.hpp"
 #include "script.hpp"
@@ -21,7 +23,12 @@ namespace sql  = sql_bridge;
 
 class server {
 public:
-	explicit server(uint16_t port, std::string path);
+	struct settings {
+		std::string metrics_path;  // served without going through lua, empty to disable
+		script_engine::settings scripting{};
+	};
+
+	server(uint16_t port, std::string path, settings s = {});
 
 	static void response(http::Client *who, int code, std::string content_type, std::string data);
 	static void html_response(http::Client *who, int code, std::string msg = std::string{});
@@ -29,8 +36,12 @@ public:
 	static void websocket_response(http::Client *who, std::string msg = std::string{});
 
 private:
-	http::Server server_;   // http service provider
-	script_engine script_;  // main scripting interface
+	void handle(http::Client *who, http::Request &request);  // an admitted request, measured by the caller
+
+	http::Server server_;       // http service provider
+	script_engine script_;      // main scripting interface
+	std::string metrics_path_;  // served without going through lua, empty to disable
+	endpoint_stats *stats_;     // totals over all requests
 };
 
 }  // namespace schwifty::krabby
\ No newline at end of file
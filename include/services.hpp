@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+
+#include <inja/inja.hpp>
+
+#include "admission.hpp"
+#include "client_cache.hpp"
+#include "client_pool.hpp"
+#include "database.hpp"
+#include "singleton.hpp"
+
+namespace schwifty::krabby {
+
+// the process wide singletons the handlers reach for, set up the same way for krabby and its benchmarks.
+// they have to outlive the server, so create them on the run loop's thread before it.
+class services {
+public:
+	struct settings {
+		client_pool::settings clients{};
+		client_cache::settings client_cache{};
+		admission::settings limits{};
+	};
+
+	services(const std::string &data_path, settings s);
+	~services();
+
+	services(const services &) = delete;
+	services &operator=(const services &) = delete;
+
+private:
+	singleton<database> db_;
+	singleton<inja::Environment> env_;
+	singleton<client_pool> clients_;
+	singleton<client_cache> client_responses_;
+	singleton<admission> gate_;
+};
+
+}  // namespace schwifty::krabby
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <variant>
+
+namespace schwifty::krabby {
+
+// key/value memory for lua that outlives the scripting contexts, so a Reload() does not start cold.
+// least recently used entries are evicted to stay within max_bytes, entries with a ttl expire on their own.
+class shared_cache {
+public:
+	using value_t = std::variant<std::string, nlohmann::json>;
+
+	struct settings {
+		size_t max_bytes = 16 * 1024 * 1024;  // 0 disables the cache, nothing is ever stored
+	};
+
+	explicit shared_cache(settings s);
+
+	shared_cache(const shared_cache &) = delete;
+	shared_cache &operator=(const shared_cache &) = delete;
+
+	// ttl in seconds, 0 keeps the entry until it is evicted
+	void set(const std::string &key, value_t value, double ttl = 0);
+	std::optional<value_t> get(const std::string &key);
+	bool remove(const std::string &key);
+	void clear();
+
+	size_t size() const { return entries_.size(); }
+	size_t bytes() const { return bytes_; }
+	uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+	uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	struct entry {
+		std::string key;
+		value_t value;
+		clock::time_point expires;
+		size_t bytes;
+	};
+
+	using lru_t = std::list<entry>;
+
+	void erase(lru_t::iterator it);
+
+	settings settings_;
+
+	lru_t lru_;  // most recently used first
+	std::unordered_map<std::string_view, lru_t::iterator> entries_;  // keys point into the entries
+	size_t bytes_ = 0;
+
+	std::atomic<uint64_t> hits_{0};
+	std::atomic<uint64_t> misses_{0};
+};
+
+}  // namespace schwifty::krabby
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <crab/crab.hpp>
+
+#include <array>
+#include <chrono>
+#include <memory>
+
+namespace schwifty::krabby {
+
+// hierarchical timing wheel driven by a single crab::Timer.
+// inserting and cancelling a timer is O(1), all timers due in a tick are fired as one batch.
+class timer_wheel {
+	struct link {
+		link *prev = this;
+		link *next = this;
+
+		bool linked() const { return next != this; }
+		void unlink() {
+			prev->next = next;
+			next->prev = prev;
+			prev = next = this;
+		}
+		void push_back(link &l) {
+			l.prev       = prev;
+			l.next       = this;
+			prev->next   = &l;
+			prev         = &l;
+		}
+	};
+
+public:
+	class entry : private link, public std::enable_shared_from_this<entry> {
+	public:
+		entry(timer_wheel &wheel, crab::Handler &&handler) : wheel_{wheel}, handler_{std::move(handler)} {}
+		~entry() { cancel(); }
+
+		entry(const entry &) = delete;
+		entry &operator=(const entry &) = delete;
+
+		void cancel();
+		bool is_set() const { return linked(); }
+
+	private:
+		friend class timer_wheel;
+
+		timer_wheel &wheel_;
+		crab::Handler handler_;
+		uint64_t expires_  = 0;  // in ticks
+		uint64_t interval_ = 0;  // in ticks, 0 for one shot timers
+	};
+
+	explicit timer_wheel(double resolution = 0.01);
+	~timer_wheel();
+
+	timer_wheel(const timer_wheel &) = delete;
+	timer_wheel &operator=(const timer_wheel &) = delete;
+
+	std::shared_ptr<entry> after(double delay, crab::Handler &&handler);
+	std::shared_ptr<entry> every(double interval, crab::Handler &&handler);
+
+	size_t size() const { return size_; }
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	static constexpr size_t slot_bits = 8;
+	static constexpr size_t slots     = size_t{1} << slot_bits;
+	static constexpr size_t levels    = 4;  // 2^32 ticks, more than a year at 10ms resolution
+
+	uint64_t to_ticks(double seconds) const;
+	uint64_t elapsed_ticks() const;
+
+	void schedule(entry &e, uint64_t expires);
+	void place(entry &e);
+	void cascade(size_t level, size_t index);
+	void on_timer();
+	void advance(uint64_t target);
+	void defer(link &batch);  // entries of a batch cut short by a throwing handler fire on the next tick
+	void arm();
+
+	double resolution_;
+	clock::time_point start_;
+	uint64_t now_ = 0;  // current tick
+	size_t size_  = 0;  // number of scheduled entries
+
+	std::array<std::array<link, slots>, levels> wheels_{};
+	crab::Timer timer_;
+};
+
+}  // namespace schwifty::krabby
@@ -0,0 +1,157 @@
+#include "admission.hpp"
+#include "log.hpp"
+#include "types.hpp"
+
+#include <algorithm>
+
+namespace schwifty::krabby {
+using namespace schwifty::logger;
+
+admission::admission(settings s, pending_calls_t &&pending_calls)
+    : settings_{s}
+    , pending_calls_{std::move(pending_calls)}
+    , drain_timer_{[this]() { drain(); }}
+    , expire_timer_{[this]() { expire(); }} {
+	metrics::gauge("krabby_admission_in_flight", "Requests admitted and waiting for their postponed response",
+	    [this]() { return static_cast<double>(in_flight()); });
+	metrics::gauge("krabby_admission_queued", "Requests waiting for an in-flight slot",
+	    [this]() { return static_cast<double>(queued()); });
+	metrics::gauge("krabby_admission_websockets", "Open websocket connections",
+	    [this]() { return static_cast<double>(websockets()); });
+	metrics::counter("krabby_admission_shed_queue_full_total", "Requests shed because the queue was full",
+	    [this]() { return static_cast<double>(shed_queue_full_.load(std::memory_order_relaxed)); });
+	metrics::counter("krabby_admission_shed_timed_out_total", "Requests shed after waiting in the queue too long",
+	    [this]() { return static_cast<double>(shed_timed_out_.load(std::memory_order_relaxed)); });
+	metrics::counter("krabby_admission_shed_client_calls_total",
+	    "Requests shed because of too many pending client calls",
+	    [this]() { return static_cast<double>(shed_client_calls_.load(std::memory_order_relaxed)); });
+	metrics::counter("krabby_admission_refused_websockets_total", "Websocket upgrades refused",
+	    [this]() { return static_cast<double>(refused_websockets_.load(std::memory_order_relaxed)); });
+}
+
+bool admission::admit(http::Client *who, http::Request &request) {
+	if (calls_overloaded()) {
+		shed(who, shed_client_calls_);
+		return false;
+	}
+
+	// queued requests go first, a newcomer must not overtake them
+	if (queue_.empty() && has_room())
+		return true;
+
+	if (settings_.max_queued > 0 && queue_.size() < settings_.max_queued) {
+		auto now      = clock::now();
+		auto deadline = now + std::chrono::duration_cast<clock::duration>(
+		                          std::chrono::duration<double>(settings_.queue_timeout));
+		metrics::queued();
+		queue_.push_back(waiting{who, std::move(request), now, deadline});
+		who->postpone_response([this, who]() {
+			auto it = std::find_if(queue_.begin(), queue_.end(), [who](auto &w) { return w.who == who; });
+			if (it == queue_.end())
+				return;
+
+			auto w = std::move(*it);
+			queue_.erase(it);
+			// went away before its turn
+			metrics::request scope{metrics::server(), w.request.header.method, w.request.header.path, w.arrived};
+		});
+
+		if (queue_.size() == 1)
+			expire_timer_.once(settings_.queue_timeout);
+		else if (has_room())
+			schedule_drain();  // the last drain stopped on pending client calls
+		log::debug("queued request to '{}', {} waiting", queue_.back().request.header.path, queue_.size());
+		return false;
+	}
+
+	shed(who, shed_queue_full_);
+	return false;
+}
+
+void admission::postpone(http::Client *who, crab::Handler &&d_handler) {
+	metrics::postponed();
+	postponed_.insert(who);
+	who->postpone_response([this, who, d_handler = std::move(d_handler)]() {
+		answered(who);
+		if (d_handler)
+			d_handler();
+	});
+}
+
+void admission::answered(http::Client *who) {
+	if (postponed_.erase(who) > 0 && !queue_.empty())
+		schedule_drain();
+}
+
+void admission::call_finished() {
+	if (!queue_.empty() && has_room() && !calls_overloaded())
+		schedule_drain();
+}
+
+bool admission::open_websocket(crab::Handler &d_handler) {
+	if (settings_.max_websockets > 0 && websockets_ >= settings_.max_websockets) {
+		bump(refused_websockets_);
+		return false;
+	}
+
+	++websockets_;
+	d_handler = [this, d_handler = std::move(d_handler)]() {
+		--websockets_;
+		if (d_handler)
+			d_handler();
+	};
+	return true;
+}
+
+void admission::reject(http::Client *who) {
+	auto res = http::Response::simple_text(503, "Krabby is overloaded, try again later");
+	res.header.headers.push_back({"Retry-After", std::to_string(settings_.retry_after)});
+	metrics::response(503, res.body.size());
+	who->write(std::move(res));
+}
+
+bool admission::has_room() const {
+	return settings_.max_in_flight == 0 || postponed_.size() < settings_.max_in_flight;
+}
+
+bool admission::calls_overloaded() const {
+	return settings_.max_client_calls > 0 && pending_calls_ && pending_calls_() >= settings_.max_client_calls;
+}
+
+void admission::shed(http::Client *who, std::atomic<uint64_t> &reason) {
+	bump(reason);
+	log::debug("shedding request, {} in flight, {} queued", postponed_.size(), queue_.size());
+	reject(who);
+}
+
+void admission::schedule_drain() { drain_timer_.once(0); }
+
+void admission::drain() {
+	while (!queue_.empty() && has_room()) {
+		if (calls_overloaded())
+			break;  // call_finished() starts it again
+
+		auto w = std::move(queue_.front());
+		queue_.pop_front();
+		if (dispatch)
+			dispatch(w.who, w.request, w.arrived);
+	}
+}
+
+void admission::expire() {
+	auto now = clock::now();
+	while (!queue_.empty() && queue_.front().deadline <= now) {
+		auto w = std::move(queue_.front());
+		queue_.pop_front();
+
+		metrics::request scope{metrics::server(), w.request.header.method, w.request.header.path, w.arrived};
+		shed(w.who, shed_timed_out_);
+	}
+
+	if (!queue_.empty()) {
+		auto left = std::chrono::duration<double>(queue_.front().deadline - now).count();
+		expire_timer_.once(left);
+	}
+}
+
+}  // namespace schwifty::krabby
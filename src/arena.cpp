@@ -0,0 +1,39 @@
+#include "arena.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace schwifty::krabby {
+
+request_arena::request_arena()
+    : buffer_{std::make_unique<std::byte[]>(initial_size)}, resource_{buffer_.get(), initial_size, &blocks_} {}
+
+request_arena &request_arena::local() {
+	static thread_local request_arena arena;
+	return arena;
+}
+
+std::pmr::memory_resource *request_arena::current() {
+	auto &arena = local();
+	if (arena.depth_ == 0)
+		throw std::logic_error("request arena used outside of a request_arena::scope");  // would never be freed
+	return &arena.resource_;
+}
+
+std::string_view request_arena::copy(std::string_view s) {
+	if (s.empty())
+		return {};
+	auto p = static_cast<char *>(current()->allocate(s.size(), 1));
+	std::memcpy(p, s.data(), s.size());
+	return {p, s.size()};
+}
+
+request_arena::scope::scope() { ++local().depth_; }
+
+request_arena::scope::~scope() {
+	auto &arena = local();
+	if (--arena.depth_ == 0)
+		arena.resource_.release();  // starts over at the initial buffer, overflow blocks go back to the pool
+}
+
+}  // namespace schwifty::krabby
@@ -0,0 +1,214 @@
+#include "client_cache.hpp"
+#include "log.hpp"
+#include "util.hpp"
+
+namespace schwifty::krabby {
+using namespace schwifty::logger;
+
+static std::string_view trim(std::string_view s) {
+	auto begin = s.find_first_not_of(" \t");
+	if (begin == std::string_view::npos)
+		return {};
+	return s.substr(begin, s.find_last_not_of(" \t") - begin + 1);
+}
+
+static const std::string *find_header(const http::Response &resp, std::string_view name) {
+	for (auto &h : resp.header.headers) {
+		if (str_tolower(h.name) == name)
+			return &h.value;
+	}
+	return nullptr;
+}
+
+// applies the freshness and validator headers of a response to a cache entry.
+// returns false if the response must not be stored at all.
+template<typename Entry>
+static bool update_freshness(Entry &e, const http::Response &resp) {
+	bool no_cache = false;
+	long max_age  = 0;
+
+	if (auto value = find_header(resp, "cache-control")) {
+		std::string_view rest{*value};
+		while (!rest.empty()) {
+			auto comma     = rest.find(',');
+			auto directive = str_tolower(std::string{trim(rest.substr(0, comma))});
+			rest           = comma == std::string_view::npos ? std::string_view{} : rest.substr(comma + 1);
+
+			if (directive == "no-store")
+				return false;
+			if (directive == "no-cache")
+				no_cache = true;
+			else if (directive.rfind("max-age=", 0) == 0)
+				max_age = std::strtol(directive.c_str() + 8, nullptr, 10);
+		}
+	}
+
+	if (auto etag = find_header(resp, "etag"))
+		e.etag = *etag;
+	if (auto last_modified = find_header(resp, "last-modified"))
+		e.last_modified = *last_modified;
+
+	// without max-age the entry is stale right away and only useful for revalidation
+	e.expires = std::chrono::steady_clock::now() + std::chrono::seconds(no_cache ? 0 : std::max(0l, max_age));
+	return max_age > 0 || !e.etag.empty() || !e.last_modified.empty();
+}
+
+client_cache::~client_cache() {
+	// calls outliving the cache must not try to unlink themselves
+	for (auto &r : ready_)
+		r.call->detach_ = nullptr;
+	for (auto &[url, fl] : flights_)
+		for (auto call : fl->waiters)
+			call->detach_ = nullptr;
+}
+
+std::shared_ptr<client_call> client_cache::get(
+    const std::string &url, client_call::r_handler_t &&r_handler, client_call::e_handler_t &&e_handler) {
+	auto call   = std::make_shared<client_call>(std::move(r_handler), std::move(e_handler));
+	auto cached = lookup(url);
+
+	if (cached && cached->expires > clock::now()) {
+		++hits_;
+		auto it       = ready_.insert(ready_.end(), ready{call.get(), cached});
+		call->detach_ = [this, it]() { ready_.erase(it); };
+		ready_timer_.once(0);
+		return call;
+	}
+
+	auto found = flights_.find(url);
+	if (found != flights_.end()) {
+		++coalesced_;
+		log::debug("joining request in flight for '{}'", url);
+		join(*found->second, *call, url);
+		return call;
+	}
+
+	++misses_;
+	auto fl   = flights_.emplace(url, std::make_unique<flight>()).first->second.get();
+	fl->stale = cached;
+	join(*fl, *call, url);
+
+	kv_map_t headers;
+	if (cached && !cached->etag.empty())
+		headers["If-None-Match"] = cached->etag;
+	if (cached && !cached->last_modified.empty())
+		headers["If-Modified-Since"] = cached->last_modified;
+
+	// the pool reports failures on a later iteration, so the flight is still there
+	fl->upstream = pool_.send(
+	    "GET", url, {}, headers, [this, url](http::Response &&resp) { on_response(url, std::move(resp)); },
+	    [this, url](std::string &&err) { on_error(url, std::move(err)); });
+
+	return call;
+}
+
+void client_cache::join(flight &fl, client_call &call, const std::string &url) {
+	auto it      = fl.waiters.insert(fl.waiters.end(), &call);
+	call.detach_ = [this, f = &fl, it, url]() {
+		f->waiters.erase(it);
+		if (f->waiters.empty() && !f->done)
+			flights_.erase(url);  // nobody is interested anymore, cancels the upstream request
+	};
+}
+
+void client_cache::on_response(const std::string &url, http::Response &&resp) {
+	auto node = flights_.extract(url);
+	if (node.empty())
+		return;
+
+	auto fl  = std::move(node.mapped());
+	fl->done = true;
+
+	auto e = std::make_shared<entry>();
+	if (resp.header.status == 304 && fl->stale) {
+		log::debug("revalidated '{}'", url);
+		*e = *fl->stale;
+		update_freshness(*e, resp);
+		insert(e);
+	} else {
+		e->url   = url;
+		e->bytes = sizeof(entry) + url.size() + resp.body.size();
+		for (auto &h : resp.header.headers)
+			e->bytes += h.name.size() + h.value.size();
+
+		auto cacheable = resp.header.status == 200 && update_freshness(*e, resp);
+		e->response    = std::move(resp);
+		if (cacheable)
+			insert(e);
+	}
+
+	// one at a time, a handler is free to cancel the other waiters
+	while (!fl->waiters.empty()) {
+		auto call = fl->waiters.front();
+		fl->waiters.pop_front();
+
+		call->detach_ = nullptr;
+		call->complete(http::Response{e->response});
+	}
+}
+
+void client_cache::on_error(const std::string &url, std::string &&err) {
+	auto node = flights_.extract(url);
+	if (node.empty())
+		return;
+
+	auto fl  = std::move(node.mapped());
+	fl->done = true;
+
+	while (!fl->waiters.empty()) {
+		auto call = fl->waiters.front();
+		fl->waiters.pop_front();
+
+		call->detach_ = nullptr;
+		call->fail(std::string{err});
+	}
+}
+
+void client_cache::deliver_ready() {
+	// hits requested by the handlers below wait for the next iteration
+	auto count = ready_.size();
+	while (count-- > 0 && !ready_.empty()) {
+		auto r = std::move(ready_.front());
+		ready_.pop_front();
+
+		r.call->detach_ = nullptr;
+		r.call->complete(http::Response{r.cached->response});
+	}
+
+	if (!ready_.empty())
+		ready_timer_.once(0);
+}
+
+std::shared_ptr<const client_cache::entry> client_cache::lookup(const std::string &url) {
+	auto found = entries_.find(url);
+	if (found == entries_.end())
+		return nullptr;
+
+	lru_.splice(lru_.begin(), lru_, found->second);
+	return *found->second;
+}
+
+void client_cache::insert(std::shared_ptr<const entry> e) {
+	if (!enabled() || e->bytes > settings_.max_bytes)
+		return;
+
+	auto found = entries_.find(e->url);
+	if (found != entries_.end()) {
+		bytes_ -= (*found->second)->bytes;
+		lru_.erase(found->second);
+	}
+
+	bytes_ += e->bytes;
+	lru_.push_front(e);
+	entries_[e->url] = lru_.begin();
+
+	while (bytes_ > settings_.max_bytes && !lru_.empty()) {
+		auto &last = lru_.back();
+		log::debug("evicting '{}' from client cache", last->url);
+		bytes_ -= last->bytes;
+		entries_.erase(last->url);
+		lru_.pop_back();
+	}
+}
+
+}  // namespace schwifty::krabby
@@ -0,0 +1,354 @@
+#include "client_pool.hpp"
+#include "log.hpp"
+#include "util.hpp"
+
+namespace schwifty::krabby {
+using namespace schwifty::logger;
+
+static bool is_idempotent(const std::string &method) {
+	return method == "GET" || method == "HEAD" || method == "PUT" || method == "DELETE" || method == "OPTIONS";
+}
+
+void client_call::cancel() {
+	if (!open_)
+		return;
+
+	open_ = false;
+	if (auto detach = std::exchange(detach_, nullptr))
+		detach();
+}
+
+void client_call::complete(http::Response &&resp) {
+	open_       = false;
+	auto handle = std::move(r_handler_);  // the handler is allowed to destroy this call
+	if (handle)
+		handle(std::move(resp));
+}
+
+void client_call::fail(std::string &&err) {
+	open_       = false;
+	auto handle = std::move(e_handler_);  // the handler is allowed to destroy this call
+	if (handle)
+		handle(std::move(err));
+}
+
+client_pool::connection::connection(client_pool &pool, host_pool &h)
+    : conn{[&pool, this]() { pool.on_event(*this); }}
+    , idle_timer{[&pool, this]() {
+	    log::debug("closing idle connection to '{}'", host.host);
+	    pool.drop(*this);
+    }}
+    , host{h} {}
+
+client_pool::~client_pool() {
+	// calls outliving the pool must not try to unlink themselves
+	for (auto &f : failed_)
+		f.call->detach_ = nullptr;
+	for (auto &[key, host] : hosts_) {
+		for (auto &w : host->queue)
+			w.call->detach_ = nullptr;
+		for (auto &c : host->connections)
+			if (c->call)
+				c->call->detach_ = nullptr;
+	}
+}
+
+std::shared_ptr<client_call> client_pool::send(std::string method, const std::string &url, std::string body,
+    const kv_map_t &headers, client_call::r_handler_t &&r_handler, client_call::e_handler_t &&e_handler) {
+	auto call = std::make_shared<client_call>(std::move(r_handler), std::move(e_handler));
+
+	target t;
+	try {
+		t = parse_url(url);
+	} catch (std::exception &e) {
+		fail(call.get(), e.what());
+		return call;
+	}
+
+	auto is_default = t.port == (t.protocol == "https" ? 443 : 80);
+
+	http::Request request;
+	request.header.method = std::move(method);
+	request.header.set_uri(t.uri);
+	request.header.host       = is_default ? t.host : fmt::format("{}:{}", t.host, t.port);
+	request.header.keep_alive = true;
+	for (auto &[name, value] : headers)
+		request.header.headers.push_back(http::Header{name, value});
+	if (!body.empty())
+		request.set_body(std::move(body));
+
+	auto &host = hosts_[fmt::format("{}://{}:{}", t.protocol, t.host, t.port)];
+	if (!host) {
+		host           = std::make_unique<host_pool>();
+		host->protocol = t.protocol;
+		host->host     = t.host;
+		host->port     = t.port;
+	}
+
+	++pending_;
+	dispatch(*host, call.get(), std::move(request));
+	return call;
+}
+
+client_pool::target client_pool::parse_url(const std::string &url) {
+	auto scheme_end = url.find("://");
+	if (scheme_end == std::string::npos)
+		throw std::runtime_error(fmt::format("invalid url '{}'", url));
+
+	target t;
+	t.protocol = str_tolower(url.substr(0, scheme_end));
+	if (t.protocol != "http" && t.protocol != "https")
+		throw std::runtime_error(fmt::format("unsupported protocol '{}'", t.protocol));
+
+	auto host_start = scheme_end + 3;
+	auto path_start = url.find_first_of("/?#", host_start);
+	auto authority  = url.substr(host_start, path_start - host_start);
+	auto user_end   = authority.rfind('@');
+	if (user_end != std::string::npos)
+		authority = authority.substr(user_end + 1);
+
+	if (path_start != std::string::npos) {
+		t.uri = url.substr(path_start, url.find('#', path_start) - path_start);
+	}
+	if (t.uri.empty() || t.uri.front() != '/')
+		t.uri.insert(0, "/");
+
+	auto port_sep = authority.rfind(':');
+	auto bracket  = authority.rfind(']');
+	if (port_sep != std::string::npos && (bracket == std::string::npos || port_sep > bracket)) {
+		t.host = authority.substr(0, port_sep);
+		t.port = static_cast<uint16_t>(std::stoul(authority.substr(port_sep + 1)));
+	} else {
+		t.host = authority;
+		t.port = t.protocol == "https" ? 443 : 80;
+	}
+
+	if (t.host.size() > 1 && t.host.front() == '[' && t.host.back() == ']')
+		t.host = t.host.substr(1, t.host.size() - 2);
+	if (t.host.empty())
+		throw std::runtime_error(fmt::format("no host in url '{}'", url));
+
+	return t;
+}
+
+void client_pool::dispatch(host_pool &host, client_call *call, http::Request &&request) {
+	auto it       = host.queue.insert(host.queue.end(), waiting{call, std::move(request)});
+	call->detach_ = [this, &host, it]() {
+		host.queue.erase(it);
+		call_finished();
+	};
+	pump(host);
+}
+
+void client_pool::pump(host_pool &host) {
+	while (!host.queue.empty()) {
+		connection *idle = nullptr;
+		for (auto &c : host.connections) {
+			if (!c->call && c->conn.is_open()) {
+				idle = c.get();
+				break;
+			}
+		}
+
+		if (!idle) {
+			if (host.connections.size() >= settings_.max_per_host || !open_connection(host))
+				return;  // waits for a connection to free up or for dns to resolve
+			idle = host.connections.back().get();
+		}
+
+		auto w = std::move(host.queue.front());
+		host.queue.pop_front();
+		write(*idle, w.call, std::move(w.request));
+	}
+}
+
+std::optional<crab::Address> client_pool::cached_address(host_pool &host) {
+	if (host.dns && host.dns->expires > std::chrono::steady_clock::now())
+		return host.dns->address;
+
+	if (!host.resolving) {
+		if (!host.resolver) {
+			host.resolver = std::make_unique<crab::DNSResolver>(
+			    [this, &host](const std::vector<crab::Address> &names) { on_resolved(host, names); });
+		}
+
+		log::debug("resolving '{}'", host.host);
+		host.resolving = true;
+		host.resolver->resolve(host.host, host.port, true, false);
+	}
+
+	return std::nullopt;
+}
+
+bool client_pool::open_connection(host_pool &host) {
+	auto c = std::make_unique<connection>(*this, host);
+
+	if (host.protocol == "https") {
+		// tls needs the host name for verification, so name resolution stays inside crab.
+		// keep-alive still saves both the lookup and the handshake for every reused connection.
+		if (!c->conn.connect(host.host, host.port, host.protocol)) {
+			fail_queue(host, fmt::format("could not connect to '{}:{}'", host.host, host.port));
+			return false;
+		}
+	} else {
+		auto address = cached_address(host);
+		if (!address)
+			return false;
+
+		if (!c->conn.connect(*address)) {
+			host.dns.reset();  // the address may be stale, resolve again next time
+			fail_queue(host, fmt::format("could not connect to '{}:{}'", host.host, host.port));
+			return false;
+		}
+	}
+
+	log::debug("opened connection #{} to '{}:{}'", host.connections.size() + 1, host.host, host.port);
+	host.connections.push_back(std::move(c));
+	return true;
+}
+
+void client_pool::on_resolved(host_pool &host, const std::vector<crab::Address> &names) {
+	host.resolving = false;
+
+	if (names.empty()) {
+		fail_queue(host, fmt::format("could not resolve '{}'", host.host));
+		return;
+	}
+
+	auto ttl = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+	    std::chrono::duration<double>(settings_.dns_ttl));
+	host.dns = dns_entry{names.front(), std::chrono::steady_clock::now() + ttl};
+	pump(host);
+}
+
+void client_pool::write(connection &c, client_call *call, http::Request &&request) {
+	c.idle_timer.cancel();
+	c.call = call;
+
+	if (c.served > 0 && is_idempotent(request.header.method))
+		c.replay = request;  // the server may have closed this connection already
+	else
+		c.replay.reset();
+
+	call->detach_ = [this, &c]() {
+		// the response may be half way through so the connection cannot be reused
+		auto &host = c.host;
+		c.call     = nullptr;
+		call_finished();
+		drop(c);
+		pump(host);
+	};
+
+	c.conn.write(std::move(request));
+}
+
+void client_pool::on_event(connection &c) {
+	auto &host = c.host;
+
+	if (!c.conn.is_open()) {
+		auto call   = std::exchange(c.call, nullptr);
+		auto replay = std::move(c.replay);
+		drop(c);
+
+		if (call && replay) {
+			log::debug("keep-alive connection to '{}' was closed, retrying request", host.host);
+			dispatch(host, call, std::move(*replay));
+		} else if (call) {
+			call_finished();
+			fail(call, fmt::format("connection to '{}' closed", host.host));
+			pump(host);
+		} else {
+			pump(host);
+		}
+		return;
+	}
+
+	http::Response resp;
+	if (!c.call || !c.conn.read_next(resp))
+		return;
+
+	auto call = std::exchange(c.call, nullptr);
+	c.replay.reset();
+	c.served += 1;
+	call->detach_ = nullptr;
+	call_finished();
+
+	if (resp.header.keep_alive)
+		release(c);
+	else {
+		drop(c);
+		pump(host);
+	}
+
+	call->complete(std::move(resp));  // last, the handler may send more requests or cancel others
+}
+
+void client_pool::release(connection &c) {
+	auto &host = c.host;
+	if (!host.queue.empty()) {
+		pump(host);
+		return;
+	}
+
+	auto idle = std::count_if(std::begin(host.connections), std::end(host.connections),
+	    [](const auto &conn) { return !conn->call; });
+	if (static_cast<size_t>(idle) > settings_.max_idle_per_host) {
+		drop(c);
+		return;
+	}
+
+	c.idle_timer.once(settings_.idle_timeout);
+}
+
+void client_pool::drop(connection &c) {
+	c.idle_timer.cancel();
+	c.conn.close();
+
+	// the connection may be dropped from inside its own handler so destruction is deferred
+	auto &list = c.host.connections;
+	auto it    = std::find_if(std::begin(list), std::end(list), [&c](const auto &conn) { return conn.get() == &c; });
+	if (it != std::end(list)) {
+		closed_.push_back(std::move(*it));
+		list.erase(it);
+		reap_timer_.once(0);
+	}
+}
+
+void client_pool::call_finished() {
+	--pending_;
+	if (finished)
+		finished();
+}
+
+void client_pool::fail_queue(host_pool &host, const std::string &err) {
+	while (!host.queue.empty()) {
+		auto call = host.queue.front().call;
+		host.queue.pop_front();
+
+		call_finished();
+		fail(call, std::string{err});
+	}
+}
+
+void client_pool::fail(client_call *call, std::string &&err) {
+	auto it       = failed_.insert(failed_.end(), failed{call, std::move(err)});
+	call->detach_ = [this, it]() { failed_.erase(it); };
+	fail_timer_.once(0);
+}
+
+void client_pool::deliver_failed() {
+	// one at a time, a failure handler is free to cancel other calls. its own failures wait for the next iteration
+	auto count = failed_.size();
+	while (count-- > 0 && !failed_.empty()) {
+		auto f = std::move(failed_.front());
+		failed_.pop_front();
+
+		f.call->detach_ = nullptr;
+		f.call->fail(std::move(f.err));
+	}
+
+	if (!failed_.empty())
+		fail_timer_.once(0);
+}
+
+}  // namespace schwifty::krabby
@@ -0,0 +1,221 @@
+#include "encoding.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#define KRABBY_X86
+#include <immintrin.h>
+#endif
+
+namespace schwifty::krabby {
+
+namespace {
+
+constexpr std::string_view to_escape{R"(<>%&#:;'")"};
+constexpr char hex_digits[] = "0123456789abcdef";
+
+constexpr auto escapable = []() {
+	std::array<bool, 256> table{};
+	for (auto c : to_escape)
+		table[static_cast<unsigned char>(c)] = true;
+	return table;
+}();
+
+// every escaped character is below 100, so an entity is always 5 bytes
+constexpr size_t entity_size = 5;
+
+inline char *write_entity(char *out, char c) {
+	out[0] = '&';
+	out[1] = '#';
+	out[2] = static_cast<char>('0' + c / 10);
+	out[3] = static_cast<char>('0' + c % 10);
+	out[4] = ';';
+	return out + entity_size;
+}
+
+// kernels work on [begin, end) and are picked once for the running cpu
+struct kernels {
+	const char *name;
+	size_t (*count)(const char *begin, const char *end);          // escapable bytes
+	const char *(*find)(const char *begin, const char *end);      // next escapable byte or end
+	void (*hex)(const char *begin, const char *end, char *out);  // writes 2 * (end - begin) chars
+};
+
+// ----------------------------------------------------------------------
+size_t scalar_count(const char *p, const char *end) {
+	size_t count{0};
+	for (; p < end; ++p)
+		count += escapable[static_cast<unsigned char>(*p)];
+	return count;
+}
+
+const char *scalar_find(const char *p, const char *end) {
+	while (p < end && !escapable[static_cast<unsigned char>(*p)])
+		++p;
+	return p;
+}
+
+void scalar_hex(const char *p, const char *end, char *out) {
+	for (; p < end; ++p) {
+		auto c = static_cast<unsigned char>(*p);
+		*out++ = hex_digits[c >> 4];
+		*out++ = hex_digits[c & 15];
+	}
+}
+
+#ifdef KRABBY_X86
+// ----------------------------------------------------------------------
+// sse2 has no byte shuffle, so bytes are compared against every escapable character
+inline int sse2_mask(const char *p) {
+	auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+	auto m = _mm_setzero_si128();
+	for (auto c : to_escape)
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+	return _mm_movemask_epi8(m);
+}
+
+size_t sse2_count(const char *p, const char *end) {
+	size_t count{0};
+	for (; end - p >= 16; p += 16)
+		count += __builtin_popcount(sse2_mask(p));
+	return count + scalar_count(p, end);
+}
+
+const char *sse2_find(const char *p, const char *end) {
+	for (; end - p >= 16; p += 16) {
+		if (auto mask = sse2_mask(p))
+			return p + __builtin_ctz(mask);
+	}
+	return scalar_find(p, end);
+}
+
+inline __m128i sse2_hex_digits(__m128i nibbles) {
+	auto above_9 = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+	auto digits  = _mm_add_epi8(nibbles, _mm_set1_epi8('0'));
+	return _mm_add_epi8(digits, _mm_and_si128(above_9, _mm_set1_epi8('a' - '0' - 10)));
+}
+
+void sse2_hex(const char *p, const char *end, char *out) {
+	const auto low_nibble = _mm_set1_epi8(0x0f);
+	for (; end - p >= 16; p += 16, out += 32) {
+		auto v  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		auto hi = sse2_hex_digits(_mm_and_si128(_mm_srli_epi16(v, 4), low_nibble));
+		auto lo = sse2_hex_digits(_mm_and_si128(v, low_nibble));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+	scalar_hex(p, end, out);
+}
+
+// ----------------------------------------------------------------------
+// avx2 classifies bytes with two nibble lookups: the low nibble table says which high nibbles
+// complete an escapable character, bit 0 standing for 0x2_ ("#%&') and bit 1 for 0x3_ (:;<>)
+#define KRABBY_AVX2 __attribute__((target("avx2")))
+
+KRABBY_AVX2 inline uint32_t avx2_mask(const char *p) {
+	const auto lo_classes = _mm256_setr_epi8(0, 0, 1, 1, 0, 1, 1, 1, 0, 0, 2, 2, 2, 0, 2, 0,  //
+	    0, 0, 1, 1, 0, 1, 1, 1, 0, 0, 2, 2, 2, 0, 2, 0);
+	const auto hi_classes = _mm256_setr_epi8(0, 0, 1, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  //
+	    0, 0, 1, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	const auto low_nibble = _mm256_set1_epi8(0x0f);
+
+	auto v       = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+	auto lo      = _mm256_shuffle_epi8(lo_classes, _mm256_and_si256(v, low_nibble));
+	auto hi      = _mm256_shuffle_epi8(hi_classes, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble));
+	auto classes = _mm256_and_si256(lo, hi);
+	return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(classes, _mm256_setzero_si256())));
+}
+
+KRABBY_AVX2 size_t avx2_count(const char *p, const char *end) {
+	size_t count{0};
+	for (; end - p >= 32; p += 32)
+		count += __builtin_popcount(avx2_mask(p));
+	return count + scalar_count(p, end);
+}
+
+KRABBY_AVX2 const char *avx2_find(const char *p, const char *end) {
+	for (; end - p >= 32; p += 32) {
+		if (auto mask = avx2_mask(p))
+			return p + __builtin_ctz(mask);
+	}
+	return scalar_find(p, end);
+}
+
+KRABBY_AVX2 void avx2_hex(const char *p, const char *end, char *out) {
+	const auto digits = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e',
+	    'f', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+	const auto low_nibble = _mm256_set1_epi8(0x0f);
+
+	for (; end - p >= 32; p += 32, out += 64) {
+		auto v  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+		auto hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble));
+		auto lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(v, low_nibble));
+
+		// unpacking works per 128 bit lane, the permutes put the halves back in order
+		auto first  = _mm256_unpacklo_epi8(hi, lo);
+		auto second = _mm256_unpackhi_epi8(hi, lo);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_permute2x128_si256(first, second, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 32), _mm256_permute2x128_si256(first, second, 0x31));
+	}
+	sse2_hex(p, end, out);
+}
+#endif
+
+const kernels &active() {
+	static const kernels k = []() -> kernels {
+#ifdef KRABBY_X86
+		if (__builtin_cpu_supports("avx2"))
+			return {"avx2", avx2_count, avx2_find, avx2_hex};
+		return {"sse2", sse2_count, sse2_find, sse2_hex};
+#else
+		return {"scalar", scalar_count, scalar_find, scalar_hex};
+#endif
+	}();
+	return k;
+}
+
+}  // namespace
+
+size_t escaped_size(std::string_view html) {
+	auto p = html.data();
+	return html.size() + active().count(p, p + html.size()) * (entity_size - 1);
+}
+
+void escape_html_into(std::string_view html, char *out) {
+	// clean runs between escapes are copied in one go
+	auto &k  = active();
+	auto p   = html.data();
+	auto end = p + html.size();
+	for (;;) {
+		auto next = k.find(p, end);
+		std::memcpy(out, p, next - p);
+		out += next - p;
+		if (next == end)
+			break;
+
+		out = write_entity(out, *next);
+		p   = next + 1;
+	}
+}
+
+std::string escape_html(std::string_view html) {
+	auto size = escaped_size(html);
+	if (size == html.size())
+		return std::string{html};
+
+	std::string out(size, '\0');  // the exact size is known upfront
+	escape_html_into(html, out.data());
+	return out;
+}
+
+std::string string_to_hex(std::string_view input) {
+	std::string out(input.size() * 2, '\0');
+	active().hex(input.data(), input.data() + input.size(), out.data());
+	return out;
+}
+
+const char *encoding_kernel() { return active().name; }
+
+}  // namespace schwifty::krabby
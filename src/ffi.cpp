@@ -0,0 +1,95 @@
+#include "ffi.hpp"
+#include "encoding.hpp"
+#include "log.hpp"
+#include "server.hpp"
+
+namespace schwifty::krabby {
+using namespace schwifty::logger;
+using json = nlohmann::json;
+
+const char *const ffi_cdefs = R"(
+	void krabby_respond(void *who, int code, const char *content_type, const char *body, size_t size);
+	size_t krabby_escaped_size(const char *html, size_t size);
+	void krabby_escape_html(const char *html, size_t size, char *out);
+	int64_t krabby_json_int(const void *j, const char *key, int64_t fallback);
+	double krabby_json_number(const void *j, const char *key, double fallback);
+	const char *krabby_json_string(const void *j, const char *key, size_t *size);
+	void krabby_json_set_int(void *j, const char *key, int64_t value);
+	void krabby_json_set_number(void *j, const char *key, double value);
+	void krabby_json_set_string(void *j, const char *key, const char *value, size_t size);
+)";
+
+namespace {
+
+// the member under key if there is one and it passes check
+template<typename Check>
+const json *member(const void *j, const char *key, Check &&check) {
+	auto &object = *static_cast<const json *>(j);
+	if (!object.is_object())
+		return nullptr;
+	auto found = object.find(key);
+	return found != object.end() && check(*found) ? &*found : nullptr;
+}
+
+}  // namespace
+
+}  // namespace schwifty::krabby
+
+using namespace schwifty::krabby;
+
+void krabby_respond(void *who, int code, const char *content_type, const char *body, size_t size) {
+	try {
+		server::response(static_cast<http::Client *>(who), code, content_type, std::string{body, size});
+	} catch (std::exception &e) {
+		log::warn("ffi respond failed: {}", e.what());
+	}
+}
+
+size_t krabby_escaped_size(const char *html, size_t size) { return escaped_size({html, size}); }
+
+void krabby_escape_html(const char *html, size_t size, char *out) { escape_html_into({html, size}, out); }
+
+int64_t krabby_json_int(const void *j, const char *key, int64_t fallback) {
+	auto m = member(j, key, [](auto &v) { return v.is_number_integer(); });
+	return m ? m->template get<int64_t>() : fallback;
+}
+
+double krabby_json_number(const void *j, const char *key, double fallback) {
+	auto m = member(j, key, [](auto &v) { return v.is_number(); });
+	return m ? m->template get<double>() : fallback;
+}
+
+const char *krabby_json_string(const void *j, const char *key, size_t *size) {
+	auto m = member(j, key, [](auto &v) { return v.is_string(); });
+	if (!m)
+		return nullptr;
+
+	// points into the json value, valid until it is changed
+	auto &text = m->template get_ref<const std::string &>();
+	*size      = text.size();
+	return text.data();
+}
+
+void krabby_json_set_int(void *j, const char *key, int64_t value) {
+	try {
+		(*static_cast<json *>(j))[key] = value;
+	} catch (std::exception &e) {
+		log::warn("ffi json set failed: {}", e.what());
+	}
+}
+
+void krabby_json_set_number(void *j, const char *key, double value) {
+	try {
+		(*static_cast<json *>(j))[key] = value;
+	} catch (std::exception &e) {
+		log::warn("ffi json set failed: {}", e.what());
+	}
+}
+
+void krabby_json_set_string(void *j, const char *key, const char *value, size_t size) {
+	try {
+		(*static_cast<json *>(j))[key] = std::string{value, size};
+	} catch (std::exception &e) {
+		log::warn("ffi json set failed: {}", e.what());
+	}
+}
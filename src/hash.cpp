@@ -0,0 +1,126 @@
+#include "hash.hpp"
+#include "encoding.hpp"
+
+namespace schwifty::krabby {
+
+namespace {
+
+inline uint32_t rotl(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+inline uint32_t load_be32(const uint8_t *p) {
+	return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+constexpr uint32_t sha256_k[64] = {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
+    0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85,
+    0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c,
+    0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+template<typename Hash>
+std::string hex_hmac(std::string_view msg, std::string_view key) {
+	hmac<Hash> mac{key};
+	mac.update(msg);
+	auto digest = mac.final();
+	return string_to_hex(std::string_view{reinterpret_cast<const char *>(digest.data()), digest.size()});
+}
+
+}  // namespace
+
+void sha1_traits::compress(uint32_t *state, const uint8_t *block) {
+	uint32_t w[80];
+	for (int i = 0; i < 16; ++i)
+		w[i] = load_be32(block + i * 4);
+	for (int i = 16; i < 80; ++i)
+		w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+	auto a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+	for (int i = 0; i < 80; ++i) {
+		uint32_t f, k;
+		if (i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5a827999;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ed9eba1;
+		} else if (i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8f1bbcdc;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xca62c1d6;
+		}
+
+		auto t = rotl(a, 5) + f + e + k + w[i];
+		e      = d;
+		d      = c;
+		c      = rotl(b, 30);
+		b      = a;
+		a      = t;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+}
+
+void sha256_traits::compress(uint32_t *state, const uint8_t *block) {
+	uint32_t w[64];
+	for (int i = 0; i < 16; ++i)
+		w[i] = load_be32(block + i * 4);
+	for (int i = 16; i < 64; ++i) {
+		auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i]    = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	auto a = state[0], b = state[1], c = state[2], d = state[3];
+	auto e = state[4], f = state[5], g = state[6], h = state[7];
+	for (int i = 0; i < 64; ++i) {
+		auto s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+		auto t1 = h + s1 + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+		auto s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+		auto t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+std::string hash_sha1(std::string_view data) {
+	sha1 h;
+	h.update(data);
+	return digest_to_string(h.final());
+}
+
+std::string hash_sha256(std::string_view data) {
+	sha256 h;
+	h.update(data);
+	return digest_to_string(h.final());
+}
+
+std::string hmac_sha1(std::string_view msg, std::string_view key) { return hex_hmac<sha1>(msg, key); }
+std::string hmac_sha256(std::string_view msg, std::string_view key) { return hex_hmac<sha256>(msg, key); }
+
+}  // namespace schwifty::krabby
@@ -0,0 +1,106 @@
+#include "lua_collector.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+
+#include <chrono>
+
+namespace schwifty::krabby {
+using namespace schwifty::logger;
+
+lua_collector::lua_collector(settings s, state_t &&state)
+    : settings_{s}, state_{std::move(state)}, idle_{[this]() { step(); }} {
+	if (settings_.mode != "incremental" && settings_.mode != "generational")
+		throw std::runtime_error(fmt::format("unknown lua gc mode '{}'", settings_.mode));
+	generational_ = LUA_VERSION_NUM >= 504 && settings_.mode == "generational";
+
+	idle_.set_active(false);
+	metrics::counter("krabby_lua_gc_idle_seconds_total", "Time spent collecting Lua garbage while the loop was idle",
+	    [this]() { return seconds(); });
+	metrics::counter("krabby_lua_gc_idle_cycles_total",
+	    "Lua collection cycles (young collections in generational mode) completed while the loop was idle",
+	    [this]() { return static_cast<double>(cycles()); });
+	// the counting object is young, so in generational mode every young collection finalizes it
+	metrics::counter("krabby_lua_gc_cycles_total",
+	    generational_ ? "Young and full Lua collections, idle or in the request path"
+	                  : "Full Lua collection cycles, idle or in the request path",
+	    [this]() { return static_cast<double>(all_cycles()); });
+}
+
+void lua_collector::configure(lua_State *L) {
+	arm(L, this);
+
+#if LUA_VERSION_NUM >= 504
+	if (generational_)
+		lua_gc(L, LUA_GCGEN, 0, 0);
+	else
+		lua_gc(L, LUA_GCINC, settings_.pause, settings_.stepmul, 0);
+#else
+	if (settings_.mode == "generational")
+		log::warn("LUA: generational gc needs lua 5.4, staying incremental");
+	if (settings_.pause > 0)
+		lua_gc(L, LUA_GCSETPAUSE, settings_.pause);
+	if (settings_.stepmul > 0)
+		lua_gc(L, LUA_GCSETSTEPMUL, settings_.stepmul);
+#endif
+}
+
+void lua_collector::touch() {
+	if (settings_.idle_budget > 0 && !active_) {
+		active_ = true;
+		idle_.set_active(true);
+	}
+}
+
+void lua_collector::step() {
+	auto L = state_();
+	if (!L) {
+		active_ = false;
+		idle_.set_active(false);
+		return;
+	}
+
+	using clock   = std::chrono::steady_clock;
+	auto start    = clock::now();
+	auto deadline = start + std::chrono::duration_cast<clock::duration>(
+	                            std::chrono::duration<double>(settings_.idle_budget));
+
+	// the smallest steps lua offers, so the budget is overrun by one step at most
+	bool finished = false;
+	if (generational_) {
+		lua_gc(L, LUA_GCSTEP, 0);  // one young collection, the cycle never reports to be complete
+		finished = true;
+	} else {
+		do {
+			finished = lua_gc(L, LUA_GCSTEP, 0) != 0;
+		} while (!finished && clock::now() < deadline);
+	}
+
+	auto spent = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+	bump(nanoseconds_, static_cast<uint64_t>(spent));
+
+	if (finished) {
+		bump(cycles_);
+		active_ = false;
+		idle_.set_active(false);  // nothing left until the next request makes garbage
+	}
+}
+
+void lua_collector::arm(lua_State *L, lua_collector *self) {
+	lua_newuserdata(L, 1);
+	lua_createtable(L, 0, 1);
+	lua_pushlightuserdata(L, self);
+	lua_pushcclosure(L, &lua_collector::collected, 1);
+	lua_setfield(L, -2, "__gc");
+	lua_setmetatable(L, -2);
+	lua_pop(L, 1);
+}
+
+int lua_collector::collected(lua_State *L) {
+	// also runs when the state is closed, lua does not finalize objects created from there on
+	auto self = static_cast<lua_collector *>(lua_touserdata(L, lua_upvalueindex(1)));
+	bump(self->all_cycles_);
+	arm(L, self);
+	return 0;
+}
+
+}  // namespace schwifty::krabby
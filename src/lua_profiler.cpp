@@ -0,0 +1,160 @@
+#include "lua_profiler.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace schwifty::krabby {
+using namespace schwifty::logger;
+
+namespace {
+
+// the handler call being watched on this thread
+thread_local lua_profiler::scope *watched = nullptr;
+
+lua_CFunction global_function(lua_State *L, const char *name) {
+	lua_getglobal(L, name);
+	auto fn = lua_tocfunction(L, -1);
+	lua_pop(L, 1);
+	return fn;
+}
+
+// true if a lua error raised now only unwinds lua functions and lua's own protected calls. any other c function
+// may be a c++ binding calling back into lua, longjmp would skip its destructors. luajit's builtins have
+// no c function pointer and are safe as well.
+bool unwindable(lua_State *L) {
+	auto pcall  = global_function(L, "pcall");
+	auto xpcall = global_function(L, "xpcall");
+
+	lua_Debug ar;
+	for (int level = 0; lua_getstack(L, level, &ar); ++level) {
+		lua_getinfo(L, "Sf", &ar);
+		auto fn = lua_tocfunction(L, -1);
+		lua_pop(L, 1);
+		if (*ar.what == 'C' && fn && fn != pcall && fn != xpcall)
+			return false;
+	}
+	return true;
+}
+
+}  // namespace
+
+lua_profiler::lua_profiler(settings s) : settings_{s}, sample_interval_{s.sample_interval} {}
+
+void lua_profiler::start(uint64_t sample_interval) {
+	sample_interval_.store(sample_interval, std::memory_order_relaxed);
+	log::info("LUA: profiler {}", sample_interval > 0 ? fmt::format("sampling every {} instructions", sample_interval)
+	                                                    : std::string{"stopped"});
+}
+
+std::string lua_profiler::dump() const {
+	std::vector<std::pair<std::string, uint64_t>> sorted;
+	{
+		auto g = std::lock_guard(m_);
+		sorted.assign(stacks_.begin(), stacks_.end());
+	}
+	std::sort(sorted.begin(), sorted.end());
+
+	std::string out;
+	for (auto &[stack, count] : sorted)
+		out += fmt::format("{} {}\n", stack, count);
+	return out;
+}
+
+void lua_profiler::reset() {
+	auto g = std::lock_guard(m_);
+	stacks_.clear();
+}
+
+lua_profiler::scope::scope(lua_profiler &profiler, lua_State *L, std::string_view route)
+    : profiler_{profiler}, L_{L}, route_{route}, previous_{watched} {
+	auto &settings = profiler_.settings_;
+	auto interval  = profiler_.sample_interval_.load(std::memory_order_relaxed);
+	if (settings.instruction_budget == 0 && settings.time_budget <= 0 && interval == 0)
+		return;
+
+	count_ = static_cast<int>(interval > 0 ? std::min<uint64_t>(interval, check_interval) : check_interval);
+	if (settings.time_budget > 0) {
+		deadline_ = clock::now() + std::chrono::duration_cast<clock::duration>(
+		                               std::chrono::duration<double>(settings.time_budget));
+	}
+
+	watched = this;
+	hooked_ = true;
+	lua_sethook(L_, &lua_profiler::hook, LUA_MASKCOUNT, count_);
+}
+
+lua_profiler::scope::~scope() {
+	if (!hooked_)
+		return;
+
+	watched = previous_;
+	if (previous_)
+		lua_sethook(previous_->L_, &lua_profiler::hook, LUA_MASKCOUNT, previous_->count_);
+	else
+		lua_sethook(L_, nullptr, 0, 0);
+}
+
+void lua_profiler::hook(lua_State *L, lua_Debug *ar) {
+	auto s = watched;
+	if (!s || ar->event != LUA_HOOKCOUNT)
+		return;
+
+	auto &self     = s->profiler_;
+	auto &settings = self.settings_;
+	s->instructions_ += s->count_;
+
+	if (auto interval = self.sample_interval_.load(std::memory_order_relaxed); interval > 0) {
+		s->since_sample_ += s->count_;
+		if (s->since_sample_ >= interval) {
+			s->since_sample_ = 0;
+			self.sample(L, *s);
+		}
+	}
+
+	if (!s->over_) {
+		auto over_instructions = settings.instruction_budget > 0 && s->instructions_ > settings.instruction_budget;
+		auto over_time         = settings.time_budget > 0 && clock::now() > s->deadline_;
+		if (!over_instructions && !over_time)
+			return;
+
+		s->over_ = over_instructions ? "instruction" : "time";
+		bump(self.aborted_);
+	}
+
+	if (!unwindable(L))
+		return;  // checked again on the next hook call
+
+	// lua errors longjmp, nothing with a destructor can be alive past this point
+	char msg[256];
+	std::snprintf(msg, sizeof(msg), "handler of '%.*s' ran over its %s budget after %llu instructions",
+	    static_cast<int>(s->route_.size()), s->route_.data(), s->over_,
+	    static_cast<unsigned long long>(s->instructions_));
+	luaL_error(L, "%s", msg);
+}
+
+void lua_profiler::sample(lua_State *L, const scope &s) {
+	// innermost frame first, collapsed stacks want the root first
+	std::vector<std::string> frames;
+	lua_Debug ar;
+	for (int level = 0; lua_getstack(L, level, &ar); ++level) {
+		lua_getinfo(L, "Sn", &ar);
+		if (*ar.what == 'C')
+			frames.push_back(fmt::format("[C] {}", ar.name ? ar.name : "?"));
+		else
+			frames.push_back(fmt::format("{} ({}:{})", ar.name ? ar.name : "?", ar.short_src, ar.linedefined));
+	}
+
+	std::string stack{s.route_};
+	for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+		stack += ';';
+		stack += *it;
+	}
+
+	auto g = std::lock_guard(m_);
+	++stacks_[stack];
+}
+
+}  // namespace schwifty::krabby
@@ -3,7 +3,7 @@
 
 #include "script.hpp"
 #include "server.hpp"
-#include "singleton.hpp"
+#include "services.hpp"
 
 using namespace schwifty::logger;
 using namespace schwifty::krabby;
@@ -14,6 +14,12 @@ int main(int argc, char *argv[]) {
 	uint16_t port{8080};
 	std::string data_path{"./"};
 	bool logging{false};
+	bool access_log{false};
+	std::string metrics_path;
+	services::settings shared{};
+	size_t client_cache_mb{0};
+	script_engine::settings scripting{};
+	size_t cache_mb{16};
 
 	try {
 		cxxopts::Options options("krabby", "Scriptable http/ws api server");
@@ -22,6 +28,26 @@ int main(int argc, char *argv[]) {
         options.add_options()
             ("p,port", "TCP port", cxxopts::value<uint16_t>(port))
             ("path", "Data path (can also be specified as first argument)", cxxopts::value<std::string>(), "path")
+            ("client-max-idle", "Idle keep-alive connections kept per client host", cxxopts::value<size_t>(shared.clients.max_idle_per_host))
+            ("client-max-per-host", "Open connections per client host", cxxopts::value<size_t>(shared.clients.max_per_host))
+            ("client-idle-timeout", "Seconds an idle client connection is kept open", cxxopts::value<double>(shared.clients.idle_timeout))
+            ("client-cache", "Megabytes of GET responses cached for ClientGet (0 disables)", cxxopts::value<size_t>(client_cache_mb))
+            ("dns-ttl", "Seconds a resolved client host address is cached", cxxopts::value<double>(shared.clients.dns_ttl))
+            ("lua-instruction-budget", "Lua instructions a route handler may run before it is aborted with a 500 (0 is unlimited)", cxxopts::value<uint64_t>(scripting.profiling.instruction_budget))
+            ("lua-time-budget", "Seconds a route handler may run before it is aborted with a 500 (0 is unlimited)", cxxopts::value<double>(scripting.profiling.time_budget))
+            ("lua-sample-interval", "Sample Lua stacks of route handlers every that many instructions (0 disables, see Profiler.start)", cxxopts::value<uint64_t>(scripting.profiling.sample_interval))
+            ("cache-size", "Megabytes held by the shared Lua cache (0 disables)", cxxopts::value<size_t>(cache_mb))
+            ("lua-gc-mode", "Lua collector mode: incremental or generational (Lua 5.4)", cxxopts::value<std::string>(scripting.gc.mode))
+            ("lua-gc-pause", "Percent the Lua heap grows before a collection cycle starts (0 keeps the default)", cxxopts::value<int>(scripting.gc.pause))
+            ("lua-gc-stepmul", "Lua collection speed relative to allocation (0 keeps the default)", cxxopts::value<int>(scripting.gc.stepmul))
+            ("lua-gc-idle-budget", "Seconds per run loop tick spent collecting Lua garbage while idle (0 disables)", cxxopts::value<double>(scripting.gc.idle_budget))
+            ("access-log", "Log one line per request to stderr", cxxopts::value<bool>(access_log))
+            ("max-in-flight", "Requests with a pending (postponed) response before new ones queue (0 is unlimited)", cxxopts::value<size_t>(shared.limits.max_in_flight))
+            ("max-queued", "Requests waiting for an in-flight slot before new ones get a 503", cxxopts::value<size_t>(shared.limits.max_queued))
+            ("queue-timeout", "Seconds a queued request waits before it gets a 503", cxxopts::value<double>(shared.limits.queue_timeout))
+            ("max-websockets", "Open websockets before upgrades get a 503 (0 is unlimited)", cxxopts::value<size_t>(shared.limits.max_websockets))
+            ("max-client-calls", "Pending client requests before new requests get a 503 (0 is unlimited)", cxxopts::value<size_t>(shared.limits.max_client_calls))
+            ("retry-after", "Seconds suggested in Retry-After of a 503", cxxopts::value<unsigned>(shared.limits.retry_after))
             ("h,help", "Help message")
         ;
 		// clang-format on
@@ -30,6 +56,11 @@ int main(int argc, char *argv[]) {
 			options.add_options()("l,logging", "Log to stderr", cxxopts::value<bool>(logging));
 		}
 
+		if constexpr (schwifty::krabby::EnableMetrics) {
+			options.add_options()("metrics-path", "Path serving prometheus metrics, e.g. /metrics (off by default)",
+			    cxxopts::value<std::string>(metrics_path));
+		}
+
 		options.positional_help("[directory]").show_positional_help();
 		options.parse_positional({"path"});
 		auto result = options.parse(argc, argv);
@@ -49,6 +80,9 @@ int main(int argc, char *argv[]) {
 
 	log::enable(logging);
 	log::level(loglevel::trace);
+	log::access_log(access_log);
+	metrics::counter("krabby_log_dropped_lines_total", "Log lines dropped because a log buffer was full",
+	    []() { return static_cast<double>(log::dropped()); });
 
 	log::info("data path: {}", data_path);
 	log::info("service port: {}", port);
@@ -56,12 +90,11 @@ int main(int argc, char *argv[]) {
 	std::signal(SIGINT, signal_handler);
 	crab::RunLoop runloop;
 
-	singleton<database> db{data_path};
-	singleton<inja::Environment> env{data_path};
-	env.set_lstrip_blocks(true);
-	env.set_trim_blocks(true);
+	shared.client_cache.max_bytes = client_cache_mb * 1024 * 1024;
+	services krabby{data_path, shared};
 
-	server app{port, data_path};
+	scripting.cache.max_bytes = cache_mb * 1024 * 1024;
+	server app{port, data_path, server::settings{EnableMetrics ? metrics_path : std::string{}, scripting}};
 
 	runloop.run();
 	return 0;
@@ -0,0 +1,294 @@
+#include "metrics.hpp"
+#include "log.hpp"
+
+#include <fmt/format.h>
+#include <map>
+
+namespace schwifty::krabby {
+
+namespace {
+
+struct snapshot {
+	uint64_t requests  = 0;
+	uint64_t errors    = 0;
+	uint64_t bytes_out = 0;
+	std::array<uint64_t, 6> status{};
+	std::array<uint64_t, histogram::buckets> counts{};
+	uint64_t sum   = 0;
+	uint64_t count = 0;
+
+	// upper bound in microseconds of the value at quantile q
+	uint64_t quantile(double q) const {
+		auto rank = static_cast<uint64_t>(q * static_cast<double>(count));
+		uint64_t seen{0};
+		for (size_t i = 0; i < counts.size(); ++i) {
+			seen += counts[i];
+			if (seen > rank)
+				return histogram::upper_bound(i);
+		}
+		return 0;
+	}
+};
+
+// bucket boundaries exported to prometheus, in microseconds
+constexpr std::array<uint64_t, 16> exported_buckets{100, 250, 500, 1'000, 2'500, 5'000, 10'000, 25'000, 50'000,
+    100'000, 250'000, 500'000, 1'000'000, 2'500'000, 5'000'000, 10'000'000};
+
+constexpr std::array<const char *, 6> status_classes{"other", "1xx", "2xx", "3xx", "4xx", "5xx"};
+
+std::string escape_label(const std::string &value) {
+	std::string out;
+	out.reserve(value.size());
+	for (auto c : value) {
+		if (c == '\\' || c == '"')
+			out.push_back('\\');
+		if (c == '\n')
+			out.append("\\n");
+		else
+			out.push_back(c);
+	}
+	return out;
+}
+
+double seconds(uint64_t us) { return static_cast<double>(us) / 1'000'000.0; }
+
+// joins label pairs into a label set, empty sets are left out entirely
+std::string label_set(const std::string &labels, const std::string &extra = {}) {
+	if (labels.empty() && extra.empty())
+		return {};
+	return fmt::format("{{{}{}{}}}", labels, labels.empty() || extra.empty() ? "" : ",", extra);
+}
+
+using group_t = std::vector<std::pair<std::string, const snapshot *>>;  // labels and stats of one kind
+
+// prometheus wants all samples of a metric family grouped under a single TYPE line
+void write_group(std::string &out, const std::string &kind, const group_t &group) {
+	auto counter = [&](const char *name, const char *help, auto value) {
+		out += fmt::format("# HELP krabby_{}_{} {}\n# TYPE krabby_{}_{} counter\n", kind, name, help, kind, name);
+		for (auto &[labels, s] : group)
+			out += fmt::format("krabby_{}_{}{} {}\n", kind, name, label_set(labels), value(*s));
+	};
+
+	counter("requests_total", "Handled requests", [](const snapshot &s) { return s.requests; });
+	counter("errors_total", "Handlers that failed with an error", [](const snapshot &s) { return s.errors; });
+	counter("bytes_out_total", "Response body bytes written", [](const snapshot &s) { return s.bytes_out; });
+
+	out += fmt::format("# HELP krabby_{}_responses_total Responses by status class\n", kind);
+	out += fmt::format("# TYPE krabby_{}_responses_total counter\n", kind);
+	for (auto &[labels, s] : group) {
+		for (size_t i = 0; i < s->status.size(); ++i) {
+			if (s->status[i] > 0) {
+				out += fmt::format("krabby_{}_responses_total{} {}\n", kind,
+				    label_set(labels, fmt::format("code=\"{}\"", status_classes[i])), s->status[i]);
+			}
+		}
+	}
+
+	out += fmt::format("# HELP krabby_{}_latency_seconds Handling latency\n", kind);
+	out += fmt::format("# TYPE krabby_{}_latency_seconds histogram\n", kind);
+	for (auto &[labels, s] : group) {
+		size_t bucket = 0;
+		uint64_t cumulative{0};
+		for (auto le : exported_buckets) {
+			for (; bucket < s->counts.size() && histogram::upper_bound(bucket) <= le + 1; ++bucket)
+				cumulative += s->counts[bucket];
+			out += fmt::format("krabby_{}_latency_seconds_bucket{} {}\n", kind,
+			    label_set(labels, fmt::format("le=\"{}\"", seconds(le))), cumulative);
+		}
+		out += fmt::format("krabby_{}_latency_seconds_bucket{} {}\n", kind, label_set(labels, "le=\"+Inf\""),
+		    s->count);
+		out += fmt::format("krabby_{}_latency_seconds_sum{} {}\n", kind, label_set(labels), seconds(s->sum));
+		out += fmt::format("krabby_{}_latency_seconds_count{} {}\n", kind, label_set(labels), s->count);
+	}
+
+	out += fmt::format("# HELP krabby_{}_latency_quantile_seconds Handling latency quantiles\n", kind);
+	out += fmt::format("# TYPE krabby_{}_latency_quantile_seconds gauge\n", kind);
+	for (auto &[labels, s] : group) {
+		for (auto q : {0.5, 0.99, 0.999}) {
+			out += fmt::format("krabby_{}_latency_quantile_seconds{} {}\n", kind,
+			    label_set(labels, fmt::format("quantile=\"{}\"", q)), seconds(s->quantile(q)));
+		}
+	}
+}
+
+}  // namespace
+
+metrics::shard &metrics::local() {
+	static thread_local std::shared_ptr<shard> local = []() {
+		auto s = std::make_shared<shard>();
+		auto g = std::lock_guard(instance().m_);
+		instance().shards_.push_back(s);
+		return s;
+	}();
+	return *local;
+}
+
+endpoint_stats *metrics::find(const char *kind, const std::string &name) {
+	auto &s  = local();
+	auto key = fmt::format("{}|{}", kind, name);
+
+	// only this thread adds to its shard, so looking up without the lock is fine
+	auto found = s.stats.find(key);
+	if (found != s.stats.end())
+		return &found->second->stats;
+
+	auto g     = std::lock_guard(s.m);
+	auto entry = std::make_unique<named_stats>();
+	entry->kind = kind;
+	entry->name = name;
+	return &s.stats.emplace(key, std::move(entry)).first->second->stats;
+}
+
+void metrics::response(int status, size_t bytes) {
+	if (auto r = current_request()) {
+		r->status_ = status;
+		r->bytes_  = bytes;
+	}
+
+	if constexpr (EnableMetrics) {
+		static thread_local auto total = server();
+		auto cls                       = status >= 100 && status < 600 ? status / 100 : 0;
+
+		bump(total->status[cls]);
+		bump(total->bytes_out, bytes);
+
+		if (auto stats = current(); stats && stats != total) {
+			bump(stats->status[cls]);
+			bump(stats->bytes_out, bytes);
+		}
+	}
+}
+
+void metrics::handled_by(std::string_view handler) {
+	if (auto r = current_request())
+		r->handler_ = handler;
+}
+
+void metrics::postponed() {
+	if (auto r = current_request())
+		r->postponed_ = true;
+}
+
+void metrics::queued() {
+	if (auto r = current_request())
+		r->queued_ = true;
+}
+
+bool metrics::answered() {
+	auto r = current_request();
+	return r && (r->status_ != 0 || r->postponed_);
+}
+
+void metrics::failed() {
+	auto r = current_request();
+	if (r)
+		r->failed_ = true;
+	if (auto stats = current(); stats && (!r || stats != r->stats_))
+		bump(stats->errors);
+}
+
+metrics::request::request(endpoint_stats *stats, std::string_view method, std::string_view path,
+    std::chrono::steady_clock::time_point start)
+    : stats_{EnableMetrics ? stats : nullptr}
+    , method_{method}
+    , path_{path}
+    , previous_{current_request()}
+    , previous_stats_{current()}
+    , logged_{logger::log::access_log()}
+    , exceptions_{std::uncaught_exceptions()} {
+	if (stats_)
+		current() = stats_;
+	current_request() = this;
+
+	if (stats_ || logged_)
+		start_ = start != std::chrono::steady_clock::time_point{} ? start : std::chrono::steady_clock::now();
+}
+
+metrics::request::~request() {
+	current_request() = previous_;
+	if (stats_)
+		current() = previous_stats_;
+	if ((!stats_ && !logged_) || queued_)
+		return;  // the request and its method and path moved to the queue
+
+	auto thrown = std::uncaught_exceptions() > exceptions_;
+	auto failed = failed_ || thrown;
+	auto us     = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_);
+
+	if (stats_) {
+		bump(stats_->requests);
+		if (failed)
+			bump(stats_->errors);
+		stats_->latency.record(us.count());
+	}
+
+	if (logged_)
+		logger::log::access(method_, path_, thrown && status_ == 0 ? 500 : status_, us.count(), bytes_,
+		    handler_.empty() ? "-" : handler_);
+}
+
+void metrics::gauge(std::string name, std::string help, gauge_t &&value) {
+	auto &m = instance();
+	auto g  = std::lock_guard(m.m_);
+	m.gauges_.push_back(gauge_entry{std::move(name), std::move(help), std::move(value), "gauge"});
+}
+
+void metrics::counter(std::string name, std::string help, gauge_t &&value) {
+	auto &m = instance();
+	auto g  = std::lock_guard(m.m_);
+	m.gauges_.push_back(gauge_entry{std::move(name), std::move(help), std::move(value), "counter"});
+}
+
+std::string metrics::prometheus() {
+	auto &m = instance();
+	std::map<std::pair<std::string, std::string>, snapshot> merged;
+	std::vector<gauge_entry> gauges;
+
+	{
+		auto g = std::lock_guard(m.m_);
+		gauges = m.gauges_;
+
+		for (auto &s : m.shards_) {
+			auto sg = std::lock_guard(s->m);
+			for (auto &[key, named] : s->stats) {
+				auto &from = named->stats;
+				auto &to   = merged[{named->kind, named->name}];
+
+				to.requests += from.requests.load(std::memory_order_relaxed);
+				to.errors += from.errors.load(std::memory_order_relaxed);
+				to.bytes_out += from.bytes_out.load(std::memory_order_relaxed);
+				for (size_t i = 0; i < to.status.size(); ++i)
+					to.status[i] += from.status[i].load(std::memory_order_relaxed);
+				for (size_t i = 0; i < to.counts.size(); ++i)
+					to.counts[i] += from.latency.counts_[i].load(std::memory_order_relaxed);
+				to.sum += from.latency.sum_.load(std::memory_order_relaxed);
+				to.count += from.latency.count_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	std::string out;
+	for (std::string kind : {"server", "route", "mount", "storage"}) {
+		group_t group;
+		for (auto &[key, s] : merged) {
+			if (key.first == kind) {
+				auto label = kind == "server" ? std::string{}
+				                              : fmt::format("{}=\"{}\"", kind == "storage" ? "op" : kind,
+				                                    escape_label(key.second));
+				group.emplace_back(std::move(label), &s);
+			}
+		}
+
+		if (!group.empty())
+			write_group(out, kind, group);
+	}
+
+	for (auto &gauge : gauges) {
+		out += fmt::format("# HELP {} {}\n# TYPE {} {}\n{} {}\n", gauge.name, gauge.help, gauge.name, gauge.type,
+		    gauge.name, gauge.value());
+	}
+
+	return out;
+}
+
+}  // namespace schwifty::krabby
@@ -0,0 +1,133 @@
+#include "request_view.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace schwifty::krabby {
+
+namespace {
+
+int hex_value(char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+bool is_escape(std::string_view in, size_t i) {
+	return in[i] == '%' && i + 2 < in.size() && hex_value(in[i + 1]) >= 0 && hex_value(in[i + 2]) >= 0;
+}
+
+// decodes into out which has room for at least in.size() characters, returns the decoded size
+size_t decode_to(std::string_view in, char *out) {
+	size_t n = 0;
+	for (size_t i = 0; i < in.size(); ++i) {
+		if (in[i] == '+') {
+			out[n++] = ' ';
+		} else if (is_escape(in, i)) {
+			out[n++] = static_cast<char>(hex_value(in[i + 1]) * 16 + hex_value(in[i + 2]));
+			i += 2;
+		} else {
+			out[n++] = in[i];  // malformed escapes are kept as they are
+		}
+	}
+	return n;
+}
+
+}  // namespace
+
+bool query_params::key_equals(std::string_view encoded, std::string_view key) {
+	if (!needs_url_decode(encoded))
+		return encoded == key;
+
+	size_t k = 0;
+	for (size_t i = 0; i < encoded.size(); ++i, ++k) {
+		auto c = encoded[i];
+		if (c == '+') {
+			c = ' ';
+		} else if (is_escape(encoded, i)) {
+			c = static_cast<char>(hex_value(encoded[i + 1]) * 16 + hex_value(encoded[i + 2]));
+			i += 2;
+		}
+		if (k >= key.size() || key[k] != c)
+			return false;
+	}
+	return k == key.size();
+}
+
+std::string_view query_params::decode(std::string_view encoded) {
+	if (!needs_url_decode(encoded))
+		return encoded;
+	auto out = static_cast<char *>(request_arena::current()->allocate(encoded.size(), 1));
+	return {out, decode_to(encoded, out)};
+}
+
+void query_params::parse() {
+	if (parsed_)
+		return;
+	parsed_ = true;
+
+	auto rest = query_;
+	while (!rest.empty()) {
+		auto pair = rest.substr(0, rest.find('&'));
+		rest.remove_prefix(std::min(rest.size(), pair.size() + 1));
+		if (pair.empty())
+			continue;
+
+		auto eq = pair.find('=');
+		if (eq == std::string_view::npos)
+			entries_.push_back({pair, {}});
+		else
+			entries_.push_back({pair.substr(0, eq), pair.substr(eq + 1)});
+	}
+}
+
+std::optional<std::string_view> query_params::find(std::string_view key) {
+	parse();
+	for (auto it = entries_.rbegin(); it != entries_.rend(); ++it) {
+		if (key_equals(it->key, key))
+			return it->value;
+	}
+	return std::nullopt;
+}
+
+std::optional<std::string_view> query_params::get(std::string_view key) {
+	auto value = find(key);
+	if (!value)
+		return std::nullopt;
+	return decode(*value);
+}
+
+const std::vector<query_params::entry> &query_params::unique_entries() {
+	if (decoded_)
+		return unique_;
+	decoded_ = true;
+
+	parse();
+	std::pmr::unordered_set<std::string_view> seen{request_arena::current()};
+	for (auto it = entries_.rbegin(); it != entries_.rend(); ++it) {
+		auto key = decode(it->key);
+		if (seen.insert(key).second)
+			unique_.push_back({key, decode(it->value)});
+	}
+	std::reverse(unique_.begin(), unique_.end());
+	return unique_;
+}
+
+const route_match &request_view::matches(const matches_handle &h) const {
+	if (h.generation != generation_ || !matches_)
+		throw std::runtime_error("route matches are only valid during the handler call");
+	return *matches_;
+}
+
+query_params &request_view::params(const params_handle &h) {
+	if (h.generation != generation_ || !matches_)
+		throw std::runtime_error("query params are only valid during the handler call");
+	return params_;
+}
+
+}  // namespace schwifty::krabby
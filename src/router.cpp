@@ -52,7 +52,8 @@ void router::patch(std::string regex, route_t handler, std::set<std::string> man
 
 void router::add_route(
     std::string method, std::string regex, route_t handler, std::set<std::string> mandatory_fields) {
-	route r{handler, mandatory_fields};
+	auto name = fmt::format("{} {}", method, regex);
+	route r{name, handler, mandatory_fields, metrics::route(name)};
 	std::regex rx{regex};
 
 	if (routes_.count(method)) {
@@ -67,12 +68,18 @@ bool router::handle(http::Client *who, http::Request &request) {
 	log::debug("check routes for '{}' with method {}", request.header.path, request.header.method);
 
 	if (routes_.count(request.header.method)) {
-		for (auto [rx, routing] : routes_.at(request.header.method)) {
-			std::cmatch cm{};
-			if (std::regex_match(request.header.path.c_str(), cm, rx)) {
-				auto params = request.parse_query_params();
+		for (auto &[rx, routing] : routes_.at(request.header.method)) {
+			if (std::regex_match(request.header.path.c_str(), candidate_, rx)) {
+				request_arena::scope arena;
+				route_match cm{candidate_};
+				metrics::scope scope{routing.stats};
+				metrics::handled_by(routing.name);
+
+				// matches and params point into the request and are only parsed when asked for
+				request_view::scope bound{cm, request.header.query_string};
+				auto &params = request_view::current().params();
 				for (auto &field : routing.mandatory_fields) {
-					if (params.find(field) == params.end()) {
+					if (!params.has(field)) {
 						log::warn("mandatory field '{}' was not passed in request", field);
 						throw std::runtime_error(fmt::format("field '{}' is mandatory", field));
 					}
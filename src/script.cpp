@@ -1,4 +1,5 @@
 #include "script.hpp"
+#include "ffi.hpp"
 #include "log.hpp"
 #include "server.hpp"
 
@@ -6,7 +7,121 @@ namespace schwifty::krabby {
 using namespace schwifty::logger;
 using json = nlohmann::json;
 
-script_engine::script_engine(std::filesystem::path path) : path_{path}, swap_timer_{[this]() { swap_context(); }} {
+namespace {
+
+// hashes and hmacs share the same streaming interface in lua, final returns the raw digest bytes
+template<typename Hasher>
+void add_hasher_methods(sol::usertype<Hasher> &type) {
+	type["init"]   = &Hasher::init;
+	type["update"] = [](Hasher &self, std::string_view data) { self.update(data); };
+	type["final"]  = [](Hasher &self) { return digest_to_string(self.final()); };
+}
+
+// the global krabby table: the hottest calls through luajit's ffi when it is there, the regular bindings otherwise,
+// so scripts using it run unchanged on either. called with the ffi declarations.
+constexpr const char *krabby_prelude = R"(
+	local cdefs = ...
+	local has_ffi, ffi = pcall(require, "ffi")
+
+	if has_ffi and jit then
+		ffi.cdef(cdefs)
+		local C    = ffi.C
+		local size = ffi.new("size_t[1]")
+
+		krabby = {
+			respond = function(who, code, content_type, body)
+				C.krabby_respond(who.ptr, code, content_type, body, #body)
+			end,
+			escape_html = function(html)
+				local n = tonumber(C.krabby_escaped_size(html, #html))
+				if n == #html then return html end
+				local out = ffi.new("char[?]", n)
+				C.krabby_escape_html(html, #html, out)
+				return ffi.string(out, n)
+			end,
+			json_int = function(j, key, fallback)
+				return tonumber(C.krabby_json_int(j.ptr, key, fallback or 0))
+			end,
+			json_number = function(j, key, fallback)
+				return C.krabby_json_number(j.ptr, key, fallback or 0)
+			end,
+			json_str = function(j, key, fallback)
+				local p = C.krabby_json_string(j.ptr, key, size)
+				if p == nil then return fallback end
+				return ffi.string(p, size[0])
+			end,
+			json_set_int = function(j, key, value) C.krabby_json_set_int(j.ptr, key, value) end,
+			json_set_number = function(j, key, value) C.krabby_json_set_number(j.ptr, key, value) end,
+			json_set_str = function(j, key, value) C.krabby_json_set_string(j.ptr, key, value, #value) end,
+			ffi = true,
+		}
+	else
+		krabby = {
+			respond = respond,
+			escape_html = escape_html,
+			json_int = function(j, key, fallback) return j:find_int(key, fallback or 0) end,
+			json_number = function(j, key, fallback) return j:find_number(key, fallback or 0) end,
+			json_str = function(j, key, fallback)
+				local value = j:find_str(key)
+				if value == nil then return fallback end
+				return value
+			end,
+			json_set_int = function(j, key, value) j:set_int(key, value) end,
+			json_set_number = function(j, key, value) j:set_number(key, value) end,
+			json_set_str = function(j, key, value) j:set_str(key, value) end,
+			ffi = false,
+		}
+	end
+)";
+
+// a failed handler is answered with a 500 unless it answered already, be it a lua error or a blown budget
+bool handled(const sol::protected_function_result &result, http::Client *who, std::string_view route) {
+	if (result.valid())
+		return true;
+
+	sol::error err = result;
+	log::warn("LUA: handler of '{}' failed: {}", route, err.what());
+	metrics::failed();
+
+	// what the handler sent or promised before it failed stands, a second response would break the connection
+	if (!metrics::answered())
+		server::text_response(who, 500, "Krabby choked on that one");
+	return false;
+}
+
+// a lua callback run straight from the loop, its errors are logged instead of unwinding into the loop
+crab::Handler protect(std::string what, sol::protected_function func) {
+	return [what = std::move(what), func = std::move(func)]() {
+		auto result = func();
+		if (!result.valid()) {
+			sol::error err = result;
+			log::warn("LUA: {} callback failed: {}", what, err.what());
+		}
+	};
+}
+
+// lua handlers get handles into the routed request instead of copies, see request_view.hpp
+router::route_t forward_to_lua(lua_profiler &profiler, std::string route, sol::protected_function func) {
+	return [&profiler, route, func](http::Client *who, http::Request &req, route_match &, query_params &) {
+		lua_profiler::scope watch{profiler, func.lua_state(), route};
+		auto &view = request_view::current();
+		handled(func(who, req, view.matches_ref(), view.params_ref()), who, route);
+	};
+}
+
+}  // namespace
+
+script_engine::script_engine(std::filesystem::path path, settings s)
+    : path_{path}
+    , profiler_{s.profiling}
+    , cache_{s.cache}
+    , gc_{s.gc, [this]() { return master_ctx_ ? master_ctx_->lua_.lua_state() : nullptr; }}
+    , swap_timer_{[this]() { swap_context(); }} {
+	metrics::gauge("krabby_lua_memory_bytes", "Memory used by the active Lua state",
+	    [this]() { return master_ctx_ ? static_cast<double>(master_ctx_->lua_.memory_used()) : 0.0; });
+	metrics::counter("krabby_lua_aborted_handlers_total", "Lua handlers aborted for running over their budget",
+	    [this]() { return static_cast<double>(profiler_.aborted()); });
+
 	try {
 		reload();
 	} catch (std::exception &e) {
@@ -21,6 +136,23 @@ void script_engine::reload() {
 	log::debug("loading up Lua scripts engine with root path '{}'", path_.string());
 	staging_ctx_->lua_.open_libraries(
 	    sol::lib::base, sol::lib::os, sol::lib::table, sol::lib::package, sol::lib::string);
+	if constexpr (UseLuaJit)
+		staging_ctx_->lua_.open_libraries(sol::lib::jit, sol::lib::ffi);
+	gc_.configure(staging_ctx_->lua_.lua_state());
+
+	// lua 5.1 ignores __pairs, route matches and params rely on it
+	staging_ctx_->lua_.script(R"(
+		if _VERSION == "Lua 5.1" then
+			local raw_pairs = pairs
+			pairs = function(t)
+				local mt = getmetatable(t)
+				if type(mt) == "table" and mt.__pairs then
+					return mt.__pairs(t)
+				end
+				return raw_pairs(t)
+			end
+		end
+	)");
 
 	register_types();
 	setup_generic_api();
@@ -28,9 +160,14 @@ void script_engine::reload() {
 	setup_mountpoint_api();
 	setup_client_api();
 
+	sol::protected_function prelude = staging_ctx_->lua_.load(krabby_prelude, "krabby prelude");
+	if (auto result = prelude(ffi_cdefs); !result.valid())
+		throw sol::error{result};
+
 	// export global objects to lua
 	staging_ctx_->lua_.set("template", sol::var(std::ref(singleton<inja::Environment>::instance())));
 	staging_ctx_->lua_.set("storage", sol::var(std::ref(singleton<database>::instance().storage())));
+	staging_ctx_->lua_.set("cache", sol::var(std::ref(cache_)));
 
 	load_extensions(path_);  // if this will throw, swap will not be scheduled
 	swap_timer_.once(0);     // execute ASAP
@@ -48,15 +185,33 @@ void script_engine::register_types() {
 	    staging_ctx_->lua_.new_usertype<crab::Timer>("timer", sol::constructors<crab::Timer(crab::Handler &&)>());
 	timer_type["once"]   = static_cast<void (crab::Timer::*)(double)>(&crab::Timer::once);
 	timer_type["cancel"] = &crab::Timer::cancel;
+	timer_type["after"]  = [this](double delay, sol::protected_function handler) {
+		return timers_.after(delay, protect("timer.after", std::move(handler)));
+	};
+	timer_type["every"] = [this](double interval, sol::protected_function handler) {
+		return timers_.every(interval, protect("timer.every", std::move(handler)));
+	};
+
+	sol::usertype<timer_wheel::entry> wheel_timer_type =
+	    staging_ctx_->lua_.new_usertype<timer_wheel::entry>("wheel_timer", sol::no_constructor);
+	wheel_timer_type["cancel"] = &timer_wheel::entry::cancel;
+	wheel_timer_type["active"] = sol::readonly_property(&timer_wheel::entry::is_set);
 
 	sol::usertype<http::Client> client_type =
 	    staging_ctx_->lua_.new_usertype<http::Client>("client", sol::no_constructor);
 	client_type["upgrade"] = [](http::Client &self, http::Client::W_handler &&w_handler, crab::Handler &&d_handler) {
+		auto &gate = singleton<admission>::instance();
+		if (!gate.open_websocket(d_handler)) {
+			gate.reject(&self);
+			return;
+		}
 		self.web_socket_upgrade(std::move(w_handler), std::move(d_handler));
+		metrics::response(101, 0);
 	};
 	client_type["postpone_response"] = [](http::Client &self, std::function<void()> &&fun) {
-		self.postpone_response(std::move(fun));
+		singleton<admission>::instance().postpone(&self, std::move(fun));
 	};
+	client_type["ptr"] = sol::readonly_property([](http::Client &self) { return static_cast<void *>(&self); });
 	client_type["id"] =
 	    sol::readonly_property([](http::Client &self) { return fmt::format("{}", static_cast<void *>(&self)); });
 
@@ -70,10 +225,10 @@ void script_engine::register_types() {
 	response_type["header"] = sol::readonly_property(&http::Response::header);
 	response_type["body"]   = sol::readonly_property(&http::Response::body);
 
-	sol::usertype<http::ClientRequestSimple> crequest_type =
-	    staging_ctx_->lua_.new_usertype<http::ClientRequestSimple>("client_request", sol::no_constructor);
-	crequest_type["cancel"] = &http::ClientRequestSimple::cancel;
-	crequest_type["isOpen"] = sol::readonly_property(&http::ClientRequestSimple::is_open);
+	sol::usertype<client_call> crequest_type =
+	    staging_ctx_->lua_.new_usertype<client_call>("client_request", sol::no_constructor);
+	crequest_type["cancel"] = &client_call::cancel;
+	crequest_type["isOpen"] = sol::readonly_property(&client_call::is_open);
 
 	sol::usertype<http::WebMessage> wm_type =
 	    staging_ctx_->lua_.new_usertype<http::WebMessage>("webmessage", sol::no_constructor);
@@ -121,8 +276,178 @@ void script_engine::register_types() {
         v.erase(std::remove(std::begin(v), std::end(v), value), std::end(v));
 	};
 
+	// route handlers get these instead of tables, nothing is copied or parsed until a handler asks for it.
+	// both throw once the handler returned, values read from them are plain lua strings and can be kept.
+	sol::usertype<matches_handle> matches_type =
+	    staging_ctx_->lua_.new_usertype<matches_handle>("route_matches", sol::no_constructor);
+	matches_type[sol::meta_function::index] =
+	    [](const matches_handle &h, sol::object key) -> sol::optional<std::string_view> {
+		auto &m = request_view::current().matches(h);
+		if (key.get_type() != sol::type::number)
+			return sol::nullopt;
+		auto idx = key.as<size_t>();
+		if (idx < 1 || idx > m.size())
+			return sol::nullopt;
+		return m[idx - 1];  // matches[1] is the whole path, groups follow
+	};
+	matches_type[sol::meta_function::length] = [](const matches_handle &h) {
+		return request_view::current().matches(h).size();
+	};
+	matches_type[sol::meta_function::pairs] = [](const matches_handle &h) {
+		auto next = [h, i = size_t{0}](sol::this_state s, sol::object, sol::object) mutable {
+			auto &m = request_view::current().matches(h);
+			if (i >= m.size())
+				return std::make_tuple(sol::make_object(s, sol::lua_nil), sol::make_object(s, sol::lua_nil));
+			++i;
+			return std::make_tuple(sol::make_object(s, i), sol::make_object(s, m[i - 1]));
+		};
+		return std::make_tuple(sol::as_function(next), h, sol::lua_nil);
+	};
+
+	sol::usertype<params_handle> params_type =
+	    staging_ctx_->lua_.new_usertype<params_handle>("query_params", sol::no_constructor);
+	params_type[sol::meta_function::index] =
+	    [](const params_handle &h, sol::object key) -> sol::optional<std::string_view> {
+		auto &params = request_view::current().params(h);
+		if (key.get_type() != sol::type::string)
+			return sol::nullopt;
+		if (auto value = params.get(key.as<std::string_view>()))
+			return *value;
+		return sol::nullopt;
+	};
+	params_type[sol::meta_function::pairs] = [](const params_handle &h) {
+		// repeated keys are only visited once, with the value that indexing would return
+		auto next = [h, i = size_t{0}](sol::this_state s, sol::object, sol::object) mutable {
+			auto &entries = request_view::current().params(h).unique_entries();
+			if (i >= entries.size())
+				return std::make_tuple(sol::make_object(s, sol::lua_nil), sol::make_object(s, sol::lua_nil));
+			auto &e = entries[i++];
+			return std::make_tuple(sol::make_object(s, e.key), sol::make_object(s, e.value));
+		};
+		return std::make_tuple(sol::as_function(next), h, sol::lua_nil);
+	};
+
+	register_json(staging_ctx_->lua_);
+
+	sol::usertype<shared_cache> cache_type =
+	    staging_ctx_->lua_.new_usertype<shared_cache>("shared_cache", sol::no_constructor);
+	cache_type["set"] = [](shared_cache &self, const std::string &key, sol::object value, sol::optional<double> ttl) {
+		if (value.is<std::string>())
+			self.set(key, value.as<std::string>(), ttl.value_or(0));
+		else if (value.is<json>())
+			self.set(key, value.as<json>(), ttl.value_or(0));
+		else
+			throw std::runtime_error("cache only takes strings and json values");
+	};
+	cache_type["get"] = [](shared_cache &self, const std::string &key, sol::this_state s) -> sol::object {
+		auto value = self.get(key);
+		if (!value)
+			return sol::make_object(s, sol::lua_nil);
+		if (auto text = std::get_if<std::string>(&*value))
+			return sol::make_object(s, std::move(*text));
+		return sol::make_object(s, std::get<json>(std::move(*value)));
+	};
+	cache_type["remove"] = &shared_cache::remove;
+	cache_type["clear"]  = &shared_cache::clear;
+	cache_type["size"]   = &shared_cache::size;
+	cache_type["bytes"]  = &shared_cache::bytes;
+	cache_type["hits"]   = &shared_cache::hits;
+	cache_type["misses"] = &shared_cache::misses;
+
+	sol::usertype<sha1> sha1_type =
+	    staging_ctx_->lua_.new_usertype<sha1>("sha1", "new", sol::constructors<sha1()>());
+	add_hasher_methods(sha1_type);
+
+	sol::usertype<sha256> sha256_type =
+	    staging_ctx_->lua_.new_usertype<sha256>("sha256", "new", sol::constructors<sha256()>());
+	add_hasher_methods(sha256_type);
+
+	// created through hmac.sha1(secret) and hmac.sha256(secret), keep them around to sign with the same secret
+	sol::usertype<hmac<sha1>> hmac_sha1_type =
+	    staging_ctx_->lua_.new_usertype<hmac<sha1>>("hmac_sha1_hasher", sol::no_constructor);
+	add_hasher_methods(hmac_sha1_type);
+
+	sol::usertype<hmac<sha256>> hmac_sha256_type =
+	    staging_ctx_->lua_.new_usertype<hmac<sha256>>("hmac_sha256_hasher", sol::no_constructor);
+	add_hasher_methods(hmac_sha256_type);
+
+	staging_ctx_->lua_["hmac"] = staging_ctx_->lua_.create_table_with(
+	    "sha1", [](std::string_view key) { return hmac<sha1>{key}; },
+	    "sha256", [](std::string_view key) { return hmac<sha256>{key}; });
+
 	// clang-format off
-    sol::usertype<json> json_type = staging_ctx_->lua_.new_usertype<json>(
+	sol::usertype<sql_bridge::context> sql_ctx_type =
+	    staging_ctx_->lua_.new_usertype<sql_bridge::context>("sqlcontext", sol::no_constructor);
+
+	using kvstore = sql_bridge::local_storage<sql_bridge::sqlite_adapter>;
+	sol::usertype<kvstore> sql_local_storage_type =
+	    staging_ctx_->lua_.new_usertype<kvstore>("sqllocalstore", sol::no_constructor);
+
+	auto save_stats   = metrics::storage("save");
+	auto load_stats   = metrics::storage("load");
+	auto remove_stats = metrics::storage("remove");
+
+	sql_local_storage_type["save"] = sol::overload(
+		[save_stats](kvstore& store, const std::string& key, const std::string& data) {
+			metrics::scope scope{save_stats};
+			store.save(key, data);
+		},
+		[save_stats](kvstore& store, const std::string& key, const strvec_t& data) {
+			metrics::scope scope{save_stats};
+			store.save(key, data);
+		},
+		[save_stats](kvstore& store, const std::string& key, const json& data) {  
+			metrics::scope scope{save_stats};
+			store.save(key, data.dump()); 
+		}
+	);
+
+	sql_local_storage_type["remove"] = sol::overload(
+		[remove_stats](kvstore& store, const std::string& key) {  
+			metrics::scope scope{remove_stats};
+			store.remove<std::string>(key);
+		},
+		[remove_stats](kvstore& store, const std::string& lst, const std::string& itm) {			
+			metrics::scope scope{remove_stats};
+        	auto data = store.load(lst, strvec_t{});
+			if (!data.empty()) {
+				data.erase(std::remove(std::begin(data), std::end(data), itm), std::end(data));
+				store.save(lst, data);
+			}
+		},
+		[remove_stats](kvstore& store, const std::string& lst, const json& itm) {			
+			metrics::scope scope{remove_stats};
+        	auto data = store.load(lst, strvec_t{});
+			if (!data.empty()) {
+				data.erase(std::remove(std::begin(data), std::end(data), itm.dump()), std::end(data));
+				store.save(lst, data);
+			}
+		}
+	);
+
+	sql_local_storage_type["load"] = sol::overload(
+		[load_stats](kvstore& store, const std::string& key, const std::string& def) {
+			metrics::scope scope{load_stats};
+			return store.load(key, def);
+		},
+		[load_stats](kvstore& store, const std::string& key, const strvec_t& def) {
+			metrics::scope scope{load_stats};
+			return store.load(key, def);
+		},
+		[load_stats](kvstore& store, const std::string& key, const json& def) {  
+			metrics::scope scope{load_stats};
+			return json::parse(store.load(key, def.dump()));
+		}
+	);
+	// clang-format on	
+}
+
+// json bindings don't depend on the rest of the engine, so they can be set up (and benchmarked) on their own
+void script_engine::register_json(sol::state &lua) {
+	using strvec_t = std::vector<std::string>;
+
+	// clang-format off
+    sol::usertype<json> json_type = lua.new_usertype<json>(
         "json", "new", sol::constructors<json()>(), 
 				"array", []() { return json::array(); },
         		"parse", [](const std::string &value) { return json::parse(value); }); 
@@ -165,51 +490,30 @@ void script_engine::register_types() {
 		[](json &j, const std::string &key, const std::vector<bool>& value) { j[key] = value; } );
 
 	json_type["empty"] = sol::readonly_property(&json::empty);
+	json_type["ptr"] = sol::readonly_property([](json &j) { return static_cast<void *>(&j); });
 	json_type["dump"] = [](json &j) { return j.dump(); };
+	// clang-format on
 
-	sol::usertype<sql_bridge::context> sql_ctx_type =
-	    staging_ctx_->lua_.new_usertype<sql_bridge::context>("sqlcontext", sol::no_constructor);
-
-	using kvstore = sql_bridge::local_storage<sql_bridge::sqlite_adapter>;
-	sol::usertype<kvstore> sql_local_storage_type =
-	    staging_ctx_->lua_.new_usertype<kvstore>("sqllocalstore", sol::no_constructor);
-
-	sql_local_storage_type["save"] = sol::overload(
-		static_cast<void(kvstore::*)(const std::string&, const std::string&)const>(&kvstore::save),
-		static_cast<void(kvstore::*)(const std::string&, const strvec_t&)const>(&kvstore::save),
-		[](kvstore& store, const std::string& key, const json& data) {  
-			store.save(key, data.dump()); 
-		}
-	);
-
-	sql_local_storage_type["remove"] = sol::overload(
-		[](kvstore& store, const std::string& key) {  
-			store.remove<std::string>(key);
-		},
-		[](kvstore& store, const std::string& lst, const std::string& itm) {			
-        	auto data = store.load(lst, strvec_t{});
-			if (!data.empty()) {
-				data.erase(std::remove(std::begin(data), std::end(data), itm), std::end(data));
-				store.save(lst, data);
-			}
-		},
-		[](kvstore& store, const std::string& lst, const json& itm) {			
-        	auto data = store.load(lst, strvec_t{});
-			if (!data.empty()) {
-				data.erase(std::remove(std::begin(data), std::end(data), itm.dump()), std::end(data));
-				store.save(lst, data);
-			}
-		}
-	);
-
-	sql_local_storage_type["load"] = sol::overload(
-		static_cast<std::string(kvstore::*)(const std::string&, const std::string&)const>(&kvstore::load),
-		static_cast<strvec_t(kvstore::*)(const std::string&, const strvec_t&)const>(&kvstore::load),
-		[](kvstore& store, const std::string& key, const json& def) {  
-			return json::parse(store.load(key, def.dump()));
-		}
-	);
-	// clang-format on	
+	// what krabby.json_* use without ffi: the same functions as the ffi entry points, so lookups never insert
+	// the key, ints are 64 bits and values of the wrong type give the fallback either way
+	json_type["find_int"] = [](const json &j, const char *key, int64_t fallback) {
+		return krabby_json_int(&j, key, fallback);
+	};
+	json_type["find_number"] = [](const json &j, const char *key, double fallback) {
+		return krabby_json_number(&j, key, fallback);
+	};
+	json_type["find_str"] = [](const json &j, const char *key) -> sol::optional<std::string_view> {
+		size_t size = 0;
+		auto text   = krabby_json_string(&j, key, &size);
+		if (!text)
+			return sol::nullopt;
+		return std::string_view{text, size};
+	};
+	json_type["set_int"]    = [](json &j, const char *key, int64_t value) { krabby_json_set_int(&j, key, value); };
+	json_type["set_number"] = [](json &j, const char *key, double value) { krabby_json_set_number(&j, key, value); };
+	json_type["set_str"]    = [](json &j, const char *key, std::string_view value) {
+		krabby_json_set_string(&j, key, value.data(), value.size());
+	};
 }
 
 void script_engine::setup_generic_api() {
@@ -221,12 +525,21 @@ void script_engine::setup_generic_api() {
 
 	staging_ctx_->lua_.set_function("generate_key", &generate_key);
 	staging_ctx_->lua_.set_function("hash_sha1", &hash_sha1);
+	staging_ctx_->lua_.set_function("hash_sha256", &hash_sha256);
 	staging_ctx_->lua_.set_function("hmac_sha1", &hmac_sha1);
+	staging_ctx_->lua_.set_function("hmac_sha256", &hmac_sha256);
 	staging_ctx_->lua_.set_function("escape_html", &escape_html);
 	staging_ctx_->lua_.set_function("string_to_hex", &string_to_hex);
 
 	using lua_disconnect_handler_t = sol::function;
 
+	// sampling can be switched on and off while serving, e.g. from an admin route
+	staging_ctx_->lua_["Profiler"] = staging_ctx_->lua_.create_table_with(
+	    "start", [&](uint64_t sample_interval) { profiler_.start(sample_interval); },
+	    "stop", [&]() { profiler_.stop(); },
+	    "dump", [&]() { return profiler_.dump(); },
+	    "reset", [&]() { profiler_.reset(); });
+
 	staging_ctx_->lua_.set_function("Reload", [&]() -> std::string {		
 		try {
 			reload();
@@ -239,49 +552,29 @@ void script_engine::setup_generic_api() {
 }
 
 void script_engine::setup_router_api() {
-	using lua_route_t = sol::function;
+	using lua_route_t = sol::protected_function;
 	staging_ctx_->lua_.set_function("Get", [&](std::string path, router::fields_t required_fields, lua_route_t func) {
-		staging_ctx_->router_.get(path, required_fields, [func](auto *who, auto &req, auto &matches, auto &params) {
-			// forward it to lua
-			std::vector<std::string> m{matches.begin(), matches.end()};
-			func(who, req, m, params);
-		});
+		staging_ctx_->router_.get(path, required_fields, forward_to_lua(profiler_, "GET " + path, func));
 		log::info("LUA: added Get route '{}'", path);
 	});
 
 	staging_ctx_->lua_.set_function("Post", [&](std::string path, router::fields_t required_fields, lua_route_t func) {
-		staging_ctx_->router_.post(path, required_fields, [func](auto *who, auto &req, auto &matches, auto &params) {
-			// forward it to lua
-			std::vector<std::string> m{matches.begin(), matches.end()};
-			func(who, req, m, params);
-		});
+		staging_ctx_->router_.post(path, required_fields, forward_to_lua(profiler_, "POST " + path, func));
 		log::info("LUA: added Post route '{}'", path);
 	});
 
 	staging_ctx_->lua_.set_function("Delete", [&](std::string path, router::fields_t required_fields, lua_route_t func) {
-		staging_ctx_->router_.delet(path, required_fields, [func](auto *who, auto &req, auto &matches, auto &params) {
-			// forward it to lua
-			std::vector<std::string> m{matches.begin(), matches.end()};
-			func(who, req, m, params);
-		});
+		staging_ctx_->router_.delet(path, required_fields, forward_to_lua(profiler_, "DELETE " + path, func));
 		log::info("LUA: added Delete route '{}'", path);
 	});
 
 	staging_ctx_->lua_.set_function("Put", [&](std::string path, router::fields_t required_fields, lua_route_t func) {
-		staging_ctx_->router_.put(path, required_fields, [func](auto *who, auto &req, auto &matches, auto &params) {
-			// forward it to lua
-			std::vector<std::string> m{matches.begin(), matches.end()};
-			func(who, req, m, params);
-		});
+		staging_ctx_->router_.put(path, required_fields, forward_to_lua(profiler_, "PUT " + path, func));
 		log::info("LUA: added Put route '{}'", path);
 	});
 
 	staging_ctx_->lua_.set_function("Patch", [&](std::string path, router::fields_t required_fields, lua_route_t func) {
-		staging_ctx_->router_.patch(path, required_fields, [func](auto *who, auto &req, auto &matches, auto &params) {
-			// forward it to lua
-			std::vector<std::string> m{matches.begin(), matches.end()};
-			func(who, req, m, params);
-		});
+		staging_ctx_->router_.patch(path, required_fields, forward_to_lua(profiler_, "PATCH " + path, func));
 		log::info("LUA: added Patch route '{}'", path);
 	});
 }
@@ -295,17 +588,46 @@ void script_engine::setup_mountpoint_api() {
 
 void script_engine::setup_client_api() {
 	using lua_creq_handler_t = sol::function;
-	staging_ctx_->lua_.set_function("ClientGet", [&](const std::string& url, lua_creq_handler_t on_res, lua_creq_handler_t on_err) {
-		auto simple = std::make_shared<http::ClientRequestSimple>([on_res](http::Response &&resp) { 
-				on_res(resp);
-			},
-            [on_err](const std::string &err) { 
-				on_err(err);
-			});
-        
-		simple->get(url);
-		return simple;
-	});
+
+	auto send = [](std::string method, const std::string &url, std::string body, const kv_map_t &headers,
+	                lua_creq_handler_t on_res, lua_creq_handler_t on_err) {
+		return singleton<client_pool>::instance().send(std::move(method), url, std::move(body), headers,
+		    [on_res](http::Response &&resp) { on_res(resp); }, [on_err](std::string &&err) { on_err(err); });
+	};
+
+	// requests without a body: ClientGet(url, [headers], on_res, on_err)
+	for (auto [name, method] : {std::pair{"ClientGet", "GET"}, std::pair{"ClientDelete", "DELETE"}}) {
+		staging_ctx_->lua_.set_function(name,
+		    sol::overload(
+		        [send, method = std::string{method}](
+		            const std::string &url, lua_creq_handler_t on_res, lua_creq_handler_t on_err) {
+			        auto &cache = singleton<client_cache>::instance();
+			        if (method == "GET" && cache.enabled()) {
+				        return cache.get(url, [on_res](http::Response &&resp) { on_res(resp); },
+				            [on_err](std::string &&err) { on_err(err); });
+			        }
+			        return send(method, url, {}, {}, on_res, on_err);
+		        },
+		        [send, method = std::string{method}](const std::string &url, const kv_map_t &headers,
+		            lua_creq_handler_t on_res, lua_creq_handler_t on_err) {
+			        return send(method, url, {}, headers, on_res, on_err);
+		        }));
+	}
+
+	// requests with a body: ClientPost(url, body, [headers], on_res, on_err)
+	for (auto [name, method] :
+	    {std::pair{"ClientPost", "POST"}, std::pair{"ClientPut", "PUT"}, std::pair{"ClientPatch", "PATCH"}}) {
+		staging_ctx_->lua_.set_function(name,
+		    sol::overload(
+		        [send, method = std::string{method}](const std::string &url, std::string body,
+		            lua_creq_handler_t on_res, lua_creq_handler_t on_err) {
+			        return send(method, url, std::move(body), {}, on_res, on_err);
+		        },
+		        [send, method = std::string{method}](const std::string &url, std::string body,
+		            const kv_map_t &headers, lua_creq_handler_t on_res, lua_creq_handler_t on_err) {
+			        return send(method, url, std::move(body), headers, on_res, on_err);
+		        }));
+	}
 }
 
 void script_engine::load_extensions(std::filesystem::path path) {
@@ -343,6 +665,12 @@ bool script_engine::handle_mountpoint(http::Client *who, http::Request &request)
 	return false;
 }
 
-bool script_engine::handle_route(http::Client *who, http::Request &request) { return master_ctx_->router_.handle(who, request); }
+bool script_engine::handle_route(http::Client *who, http::Request &request) {
+	if (!master_ctx_->router_.handle(who, request))
+		return false;
+
+	gc_.touch();  // the handler left garbage behind
+	return true;
+}
 
 }  // namespace schwifty::krabby
\ No newline at end of file
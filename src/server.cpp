@@ -11,21 +11,50 @@ using namespace std;
 using namespace inja;
 using json = nlohmann::json;
 
-server::server(uint16_t port, std::string path) : server_{port}, script_{path} {
+server::server(uint16_t port, std::string path, settings s)
+    : server_{port}
+    , script_{path, s.scripting}
+    , metrics_path_{s.metrics_path}
+    , stats_{metrics::server()} {
 	// ----------------------------------------------------------------------
 	server_.r_handler = [&](auto *who, http::Request &&request) {
 		log::trace("request to '{}'", request.header.path);
+		metrics::request scope{stats_, request.header.method, request.header.path};
 
-		if (script_.handle_mountpoint(who, request))
-			return;  // handled by some mountpoint
+		if (!metrics_path_.empty() && request.header.path == metrics_path_) {
+			http::Response res;
+			res.header.status = 200;
+			res.header.set_content_type("text/plain", "version=0.0.4");
+			res.set_body(metrics::prometheus());
+			metrics::response(200, res.body.size());
+			who->write(std::move(res));
+			return;
+		}
 
-		if (script_.handle_route(who, request))
-			return;  // handled by some route
+		// over the limits requests wait or get a 503 right here, before any lua runs
+		if (singleton<admission>::instance().admit(who, request))
+			handle(who, request);
+	};
 
-		who->write(http::Response::simple_html(404, "Krabby is angry"));
+	singleton<admission>::instance().dispatch = [this](auto *who, http::Request &request, auto arrived) {
+		metrics::request scope{stats_, request.header.method, request.header.path, arrived};
+		handle(who, request);
 	};
+}
 
-}  // namespace schwifty::krabby
+void server::handle(http::Client *who, http::Request &request) {
+	request_arena::scope arena;  // request scoped data of the handlers below is released in one go
+
+	if (script_.handle_mountpoint(who, request))
+		return;  // handled by some mountpoint
+
+	if (script_.handle_route(who, request))
+		return;  // handled by some route
+
+	auto res = http::Response::simple_html(404, "Krabby is angry");
+	metrics::response(404, res.body.size());
+	who->write(std::move(res));
+}
 
 void server::websocket_response(http::Client *who, std::string msg) {
 	who->write(http::WebMessage(http::WebMessage::OPCODE_TEXT, std::move(msg)));
@@ -34,17 +63,24 @@ void server::websocket_response(http::Client *who, std::string msg) {
 void server::response(http::Client *who, int code, std::string content_type, std::string data) {
 	http::Response res;
 
+	res.header.status = code;
 	res.header.set_content_type(content_type);
 	res.set_body(std::move(data));
 
+	metrics::response(code, res.body.size());
+	singleton<admission>::instance().answered(who);
 	who->write(std::move(res));
 }
 
 void server::html_response(http::Client *who, int code, std::string msg) {
+	metrics::response(code, msg.size());
+	singleton<admission>::instance().answered(who);
 	who->write(http::Response::simple_html(code, std::move(msg)));
 }
 
 void server::text_response(http::Client *who, int code, std::string msg) {
+	metrics::response(code, msg.size());
+	singleton<admission>::instance().answered(who);
 	who->write(http::Response::simple_text(code, std::move(msg)));
 }
 
@@ -0,0 +1,24 @@
+#include "services.hpp"
+#include "encoding.hpp"
+
+namespace schwifty::krabby {
+
+services::services(const std::string &data_path, settings s)
+    : db_{data_path}
+    , env_{data_path}
+    , clients_{s.clients}
+    , client_responses_{clients_, s.client_cache}
+    , gate_{s.limits, [this]() { return clients_.pending(); }} {
+	env_.set_lstrip_blocks(true);
+	env_.set_trim_blocks(true);
+	env_.add_callback(
+	    "escape_html", 1, [](inja::Arguments &args) { return escape_html(args.at(0)->get<std::string>()); });
+
+	clients_.finished = [this]() { gate_.call_finished(); };
+}
+
+services::~services() {
+	clients_.finished = nullptr;  // the gate goes first
+}
+
+}  // namespace schwifty::krabby
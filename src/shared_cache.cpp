@@ -0,0 +1,91 @@
+#include "shared_cache.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+
+namespace schwifty::krabby {
+using namespace schwifty::logger;
+
+namespace {
+
+// what an entry roughly costs, json is counted by its serialized size
+size_t estimate(const std::string &key, const shared_cache::value_t &value) {
+	constexpr size_t overhead = 96;  // list node, map node and bookkeeping
+	if (auto text = std::get_if<std::string>(&value))
+		return overhead + key.size() + text->size();
+	return overhead + key.size() + std::get<nlohmann::json>(value).dump().size();
+}
+
+}  // namespace
+
+shared_cache::shared_cache(settings s) : settings_{s} {
+	metrics::counter("krabby_cache_hits_total", "Lookups answered by the shared Lua cache",
+	    [this]() { return static_cast<double>(hits()); });
+	metrics::counter("krabby_cache_misses_total", "Lookups of missing or expired keys in the shared Lua cache",
+	    [this]() { return static_cast<double>(misses()); });
+	metrics::gauge("krabby_cache_bytes", "Approximate memory held by the shared Lua cache",
+	    [this]() { return static_cast<double>(bytes()); });
+}
+
+void shared_cache::set(const std::string &key, value_t value, double ttl) {
+	remove(key);
+
+	auto bytes = estimate(key, value);
+	if (bytes > settings_.max_bytes) {
+		log::debug("not caching '{}', {} bytes do not fit the cache", key, bytes);
+		return;
+	}
+
+	auto expires = clock::time_point::max();
+	if (ttl > 0)
+		expires = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(ttl));
+
+	lru_.push_front(entry{key, std::move(value), expires, bytes});
+	entries_[lru_.front().key] = lru_.begin();
+	bytes_ += bytes;
+
+	while (bytes_ > settings_.max_bytes && !lru_.empty()) {
+		log::debug("evicting '{}' from shared cache", lru_.back().key);
+		erase(std::prev(lru_.end()));
+	}
+}
+
+std::optional<shared_cache::value_t> shared_cache::get(const std::string &key) {
+	auto found = entries_.find(key);
+	if (found == entries_.end()) {
+		bump(misses_);
+		return std::nullopt;
+	}
+
+	auto it = found->second;
+	if (it->expires <= clock::now()) {
+		erase(it);
+		bump(misses_);
+		return std::nullopt;
+	}
+
+	bump(hits_);
+	lru_.splice(lru_.begin(), lru_, it);
+	return it->value;
+}
+
+bool shared_cache::remove(const std::string &key) {
+	auto found = entries_.find(key);
+	if (found == entries_.end())
+		return false;
+	erase(found->second);
+	return true;
+}
+
+void shared_cache::clear() {
+	entries_.clear();
+	lru_.clear();
+	bytes_ = 0;
+}
+
+void shared_cache::erase(lru_t::iterator it) {
+	bytes_ -= it->bytes;
+	entries_.erase(it->key);
+	lru_.erase(it);
+}
+
+}  // namespace schwifty::krabby
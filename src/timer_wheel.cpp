@@ -0,0 +1,170 @@
+#include "timer_wheel.hpp"
+#include "log.hpp"
+
+namespace schwifty::krabby {
+using namespace schwifty::logger;
+
+void timer_wheel::entry::cancel() {
+	if (linked()) {
+		unlink();
+		--wheel_.size_;
+	}
+	interval_ = 0;  // stops a periodic timer from being rescheduled while it fires
+}
+
+timer_wheel::timer_wheel(double resolution)
+    : resolution_{resolution}, start_{clock::now()}, timer_{[this]() { on_timer(); }} {}
+
+timer_wheel::~timer_wheel() {
+	// entries outliving the wheel must not try to unlink themselves
+	for (auto &wheel : wheels_) {
+		for (auto &slot : wheel) {
+			while (slot.linked())
+				slot.next->unlink();
+		}
+	}
+}
+
+std::shared_ptr<timer_wheel::entry> timer_wheel::after(double delay, crab::Handler &&handler) {
+	auto e = std::make_shared<entry>(*this, std::move(handler));
+	schedule(*e, elapsed_ticks() + std::max<uint64_t>(to_ticks(delay), 1));
+	return e;
+}
+
+std::shared_ptr<timer_wheel::entry> timer_wheel::every(double interval, crab::Handler &&handler) {
+	auto e       = std::make_shared<entry>(*this, std::move(handler));
+	e->interval_ = std::max<uint64_t>(to_ticks(interval), 1);
+	schedule(*e, elapsed_ticks() + e->interval_);
+	return e;
+}
+
+uint64_t timer_wheel::to_ticks(double seconds) const {
+	return seconds > 0 ? static_cast<uint64_t>(seconds / resolution_ + 0.5) : 0;
+}
+
+uint64_t timer_wheel::elapsed_ticks() const {
+	return static_cast<uint64_t>(std::chrono::duration<double>(clock::now() - start_).count() / resolution_);
+}
+
+void timer_wheel::schedule(entry &e, uint64_t expires) {
+	if (size_ == 0)
+		now_ = std::max(now_, elapsed_ticks());  // nothing to fire while the wheel was idle
+
+	e.expires_ = std::max(expires, now_ + 1);
+	place(e);
+	++size_;
+
+	if (size_ == 1)
+		timer_.once(resolution_);
+}
+
+void timer_wheel::place(entry &e) {
+	auto delta = e.expires_ > now_ ? e.expires_ - now_ : 0;
+	auto at    = e.expires_;
+
+	size_t level = 0;
+	while (level + 1 < levels && delta >= (uint64_t{1} << (slot_bits * (level + 1))))
+		++level;
+
+	// too far in the future, park it in the last level and let cascading bring it closer
+	if (delta >= (uint64_t{1} << (slot_bits * levels)))
+		at = now_ + (uint64_t{1} << (slot_bits * levels)) - 1;
+
+	wheels_[level][(at >> (slot_bits * level)) & (slots - 1)].push_back(e);
+}
+
+void timer_wheel::cascade(size_t level, size_t index) {
+	link batch;
+	auto &slot = wheels_[level][index];
+	while (slot.linked()) {
+		auto l = slot.next;
+		l->unlink();
+		batch.push_back(*l);
+	}
+
+	while (batch.linked()) {
+		auto &e = static_cast<entry &>(*batch.next);
+		e.unlink();
+		place(e);
+	}
+}
+
+void timer_wheel::advance(uint64_t target) {
+	while (now_ < target && size_ > 0) {
+		++now_;
+
+		for (size_t level = 1; level < levels; ++level) {
+			auto shift = slot_bits * level;
+			if ((now_ & ((uint64_t{1} << shift) - 1)) != 0)
+				break;
+			cascade(level, (now_ >> shift) & (slots - 1));
+		}
+
+		// everything due in this tick is detached first so handlers can freely schedule or cancel
+		link batch;
+		auto &slot = wheels_[0][now_ & (slots - 1)];
+		while (slot.linked()) {
+			auto l = slot.next;
+			l->unlink();
+			batch.push_back(*l);
+		}
+
+		while (batch.linked()) {
+			auto &e   = static_cast<entry &>(*batch.next);
+			auto keep = e.weak_from_this().lock();  // the handler may drop the last reference
+
+			e.unlink();
+			--size_;
+
+			if (e.interval_ > 0) {
+				e.expires_ += e.interval_;
+				if (e.expires_ <= now_)
+					e.expires_ = now_ + e.interval_;  // fell behind, skip the missed runs
+				place(e);
+				++size_;
+			}
+
+			if (!e.handler_)
+				continue;
+			try {
+				e.handler_();
+			} catch (...) {
+				defer(batch);  // the wheel stays consistent for whoever catches this
+				throw;
+			}
+		}
+	}
+
+	if (size_ == 0)
+		now_ = std::max(now_, target);
+}
+
+void timer_wheel::defer(link &batch) {
+	while (batch.linked()) {
+		auto &e = static_cast<entry &>(*batch.next);
+		e.unlink();
+		e.expires_ = now_ + 1;
+		place(e);
+	}
+}
+
+void timer_wheel::on_timer() {
+	try {
+		advance(elapsed_ticks());
+	} catch (...) {
+		arm();
+		throw;
+	}
+	arm();
+}
+
+void timer_wheel::arm() {
+	if (size_ > 0) {
+		auto next = start_ + std::chrono::duration_cast<clock::duration>(
+		                         std::chrono::duration<double>(resolution_ * static_cast<double>(now_ + 1)));
+		auto wait = std::chrono::duration<double>(next - clock::now()).count();
+		timer_.once(std::max(wait, 0.0));
+	}
+}
+
+}  // namespace schwifty::krabby